@@ -7,6 +7,8 @@
 
 #define MEMORY_SIZE 65536
 #define ROM_SIZE 32768   // 32 KB ROM
+#define MEMORY_PAGE_SIZE 256
+#define MEMORY_PAGE_COUNT (MEMORY_SIZE / MEMORY_PAGE_SIZE)
 #define ZERO_PAGE_END        0x00FF
 #define STACK_START          0x0100
 #define STACK_END            0x01FF
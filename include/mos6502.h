@@ -0,0 +1,74 @@
+#ifndef MOS6502_H
+#define MOS6502_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// libmos6502: embeddable 6502 machine with a stable C API.
+//
+// A machine starts with the emulator's memory map (2 KB RAM mirrored to
+// $1FFF, I/O at $2000-$3FFF, 32 KB ROM at $8000). mos6502_set_bus() hands
+// every access to host callbacks instead; mos6502_map() then gives pages
+// of host memory back to the machine, and accesses to mapped pages are a
+// table lookup with no call. Hosts with a fixed memory map that want the
+// accessors compiled into the interpreter can use mos6502_inline.h.
+//
+// A machine may be run from any thread, one thread at a time.
+
+#define MOS6502_API_VERSION 1
+
+#if defined(__GNUC__)
+#define MOS6502_API __attribute__((visibility("default")))
+#else
+#define MOS6502_API
+#endif
+
+typedef struct Mos6502 Mos6502;
+
+typedef uint8_t (*Mos6502Read)(void *context, uint16_t address);
+typedef void (*Mos6502Write)(void *context, uint16_t address, uint8_t value);
+
+typedef struct {
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t status;
+    uint8_t running;            // Cleared when the CPU halts (BRK with no IRQ vector)
+    uint16_t pc;
+    uint64_t cycles;
+} Mos6502State;
+
+MOS6502_API int mos6502_api_version(void);
+
+// <variant> is a --list-variants name, or NULL for the reference engine.
+// The machine is reset with PC = $0600.
+MOS6502_API Mos6502 *mos6502_create(const char *variant);
+MOS6502_API void mos6502_destroy(Mos6502 *machine);
+
+// NULL callbacks restore the built-in memory map. Mappings made earlier
+// are dropped either way.
+MOS6502_API void mos6502_set_bus(Mos6502 *machine, Mos6502Read read, Mos6502Write write,
+                                 void *context);
+// Maps <size> bytes of host memory at <address>, both page aligned.
+// Writes to a read-only mapping go to the write callback.
+MOS6502_API int mos6502_map(Mos6502 *machine, uint16_t address, uint32_t size, uint8_t *memory,
+                            int writable);
+
+// Stores into mapped pages (read-only ones included) or through the write
+// callback; returns -1 if some byte had nowhere to go
+MOS6502_API int mos6502_load(Mos6502 *machine, const uint8_t *image, size_t size,
+                             uint16_t address);
+
+// Runs until the CPU halts or at least <cycles> more cycles have passed;
+// returns the cycles run
+MOS6502_API uint64_t mos6502_run(Mos6502 *machine, uint64_t cycles);
+
+MOS6502_API void mos6502_get_state(const Mos6502 *machine, Mos6502State *state);
+MOS6502_API void mos6502_set_state(Mos6502 *machine, const Mos6502State *state);
+
+// Bus accesses as the CPU would make them, callbacks included
+MOS6502_API uint8_t mos6502_peek(Mos6502 *machine, uint16_t address);
+MOS6502_API void mos6502_poke(Mos6502 *machine, uint16_t address, uint8_t value);
+
+#endif
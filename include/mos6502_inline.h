@@ -0,0 +1,151 @@
+#ifndef MOS6502_INLINE_H
+#define MOS6502_INLINE_H
+
+// Header-only 6502 interpreter for hosts with a fixed memory map.
+//
+// Define MOS6502_READ(address) and MOS6502_WRITE(address, value) before
+// including this header, as macros or static inline functions. They are
+// expanded straight into the instruction handlers, so a host whose memory
+// is a plain array pays a load or store per access rather than a call.
+// Everything here is static: include it in one translation unit per
+// memory map, and do not mix it with cpu.h in the same unit.
+//
+// Optional:
+//   MOS6502_OPCODES  MOS6502_OPS_* mask of opcode sets to decode
+//                    (default: all, the same table as execute())
+//   MOS6502_DECIMAL  0 to ignore the decimal flag in ADC/SBC (default 1)
+//
+// Semantics match the library's reference engine, minus HLE hooks and
+// I/O devices, which belong to the host's accessors. Decimal ADC/SBC are
+// computed in place rather than through the library's tables, so the
+// header adds no data. The host sees only the MOS6502_ and mos6502_inline_
+// names below and the Mos6502Cpu register file.
+
+#if !defined(MOS6502_READ) || !defined(MOS6502_WRITE)
+#error "Define MOS6502_READ(address) and MOS6502_WRITE(address, value) first"
+#endif
+
+#include <stdint.h>
+
+#define MOS6502_FLAG_NEGATIVE   0x80
+#define MOS6502_FLAG_OVERFLOW   0x40
+#define MOS6502_FLAG_UNUSED     0x20
+#define MOS6502_FLAG_BREAK      0x10
+#define MOS6502_FLAG_DECIMAL    0x08
+#define MOS6502_FLAG_INTERRUPT  0x04
+#define MOS6502_FLAG_ZERO       0x02
+#define MOS6502_FLAG_CARRY      0x01
+
+// Opcode sets, as the variants column of src/opcodes.def
+#define MOS6502_OPS_OFFICIAL    0x01
+#define MOS6502_OPS_ILLEGAL     0x02
+#define MOS6502_OPS_65C02       0x04
+#define MOS6502_OPS_LEGACY      0x08
+
+#ifndef MOS6502_OPCODES
+#define MOS6502_OPCODES (MOS6502_OPS_OFFICIAL | MOS6502_OPS_ILLEGAL | \
+                         MOS6502_OPS_65C02 | MOS6502_OPS_LEGACY)
+#endif
+#ifndef MOS6502_DECIMAL
+#define MOS6502_DECIMAL 1
+#endif
+
+// The handlers are written against the emulator's internal names; they
+// are renamed or scoped to this header and dropped again at the end
+#include "../src/handler_names.inc"
+#include "../src/cpu_state.h"
+#define OPS_OFFICIAL MOS6502_OPS_OFFICIAL
+#define OPS_ILLEGAL  MOS6502_OPS_ILLEGAL
+#define OPS_65C02    MOS6502_OPS_65C02
+#define OPS_LEGACY   MOS6502_OPS_LEGACY
+
+#define HANDLER static inline
+#define HANDLERS_HLE 0
+#define HANDLERS_DECIMAL_TABLES 0
+#define read_memory(address) MOS6502_READ(address)
+#define write_memory(address, value) MOS6502_WRITE(address, value)
+#include "../src/handlers.inc"
+#undef read_memory
+#undef write_memory
+
+#if !MOS6502_DECIMAL
+#undef adc_immediate
+#undef sbc_immediate
+#define adc_immediate mos6502_inline_adc_immediate_binary
+#define sbc_immediate mos6502_inline_sbc_immediate_binary
+#endif
+
+static inline void mos6502_inline_reset(Mos6502Cpu *cpu, uint16_t pc) {
+    cpu->A = 0;
+    cpu->X = 0;
+    cpu->Y = 0;
+    cpu->SP = 0xFF;
+    cpu->status = 0;
+    cpu->PC = pc;
+    cpu->is_running = 1;
+    cpu->cycles = 0;
+}
+
+// One instruction; returns 0 for an opcode outside MOS6502_OPCODES,
+// which is skipped like execute() skips unknown opcodes
+static inline int mos6502_inline_step(Mos6502Cpu *cpu) {
+    uint8_t *memory = NULL;     // Named by the handler calls in opcodes.def
+    uint8_t opcode = fetch(cpu, memory);
+
+    switch (opcode) {
+#define OPCODE(code, mnemonic, mode, base_cycles, variants, handler) \
+        case code: \
+            if ((variants) & (MOS6502_OPCODES)) { handler; cpu->cycles += base_cycles; return 1; } \
+            return 0;
+#include "../src/opcodes.def"
+#undef OPCODE
+        default:
+            return 0;
+    }
+}
+
+// Runs until the CPU halts or at least <cycles> more cycles have passed;
+// returns the cycles run
+static inline uint64_t mos6502_inline_run(Mos6502Cpu *cpu, uint64_t cycles) {
+    uint64_t start = cpu->cycles;
+    while (cpu->is_running && cpu->cycles - start < cycles)
+        mos6502_inline_step(cpu);
+    return cpu->cycles - start;
+}
+
+#define HANDLER_NAMES_UNDEF
+#include "../src/handler_names.inc"
+#undef OPS_OFFICIAL
+#undef OPS_ILLEGAL
+#undef OPS_65C02
+#undef OPS_LEGACY
+#undef FLAG_NEGATIVE
+#undef FLAG_OVERFLOW
+#undef FLAG_UNUSED
+#undef FLAG_BREAK
+#undef FLAG_DECIMAL
+#undef FLAG_INTERRUPT
+#undef FLAG_ZERO
+#undef FLAG_CARRY
+#undef SET_FLAG
+#undef CLEAR_FLAG
+#undef CHECK_FLAG
+#undef CPU_STATE_H
+#undef MEMORY_SIZE
+#undef ROM_SIZE
+#undef MEMORY_PAGE_SIZE
+#undef MEMORY_PAGE_COUNT
+#undef ZERO_PAGE_END
+#undef STACK_START
+#undef STACK_END
+#undef RAM_START
+#undef RAM_END
+#undef MIRRORED_RAM_START
+#undef MIRRORED_RAM_END
+#undef IO_REGISTERS_START
+#undef IO_REGISTERS_END
+#undef ROM_START
+#undef ROM_END
+#undef COMMON_H
+
+#endif
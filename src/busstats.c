@@ -0,0 +1,134 @@
+#define _POSIX_C_SOURCE 200809L
+#include "busstats.h"
+#include <stddef.h>
+#include <string.h>
+
+#ifdef BUS_STATS
+#include <pthread.h>
+
+_Thread_local BusStatsBlock *bus_stats_block = NULL;
+atomic_int bus_stats_signalled = 0;
+
+static BusStatsBlock *blocks = NULL;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *stats_file = NULL;
+
+// First access from a thread. Blocks outlive their threads so that the
+// counts survive until the heatmap is written.
+BusStatsBlock *bus_stats_attach(void) {
+    BusStatsBlock *block = calloc(1, sizeof(BusStatsBlock));
+    if (block == NULL) {
+        printf("Error: Out of memory for bus statistics\n");
+        exit(1);
+    }
+    pthread_mutex_lock(&blocks_lock);
+    block->next = blocks;
+    blocks = block;
+    pthread_mutex_unlock(&blocks_lock);
+    bus_stats_block = block;
+    return block;
+}
+
+static void on_signal(int signal_number) {
+    (void)signal_number;
+    atomic_store_explicit(&bus_stats_signalled, 1, memory_order_relaxed);
+}
+
+// Called from the instruction loop after SIGUSR1. Several threads can see
+// the flag at once; only the one that clears it writes the file.
+void bus_stats_signal_dump(void) {
+    if (!atomic_exchange(&bus_stats_signalled, 0))
+        return;
+    if (stats_file)
+        bus_stats_write(stats_file);
+}
+
+static void write_at_exit(void) {
+    bus_stats_write(stats_file);
+}
+
+int bus_stats_enable(const char *filename) {
+    stats_file = filename;
+    atexit(write_at_exit);
+    // sigaction rather than signal(): under _POSIX_C_SOURCE the latter
+    // resets the handler after one delivery, so a second SIGUSR1 would kill
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+    return 0;
+}
+
+static uint64_t total(size_t offset, int index) {
+    uint64_t sum = 0;
+    for (BusStatsBlock *block = blocks; block; block = block->next) {
+        _Atomic uint64_t *counters = (_Atomic uint64_t *)((char *)block + offset);
+        sum += atomic_load_explicit(&counters[index], memory_order_relaxed);
+    }
+    return sum;
+}
+
+int bus_stats_write(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Error: Unable to write bus statistics to %s\n", filename);
+        return -1;
+    }
+    size_t length = strlen(filename);
+    int json = length >= 5 && strcmp(filename + length - 5, ".json") == 0;
+
+    pthread_mutex_lock(&blocks_lock);
+    fprintf(file, json ? "{\"pages\": [" : "page,address,reads,writes,fetches\n");
+    const char *separator = "";
+    for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+        uint64_t reads = total(offsetof(BusStatsBlock, reads), page);
+        uint64_t writes = total(offsetof(BusStatsBlock, writes), page);
+        uint64_t fetches = total(offsetof(BusStatsBlock, fetches), page);
+        if (reads == 0 && writes == 0 && fetches == 0)
+            continue;
+        fprintf(file, json ? "%s\n  {\"page\": %d, \"address\": \"$%04X\", \"reads\": %llu, "
+                             "\"writes\": %llu, \"fetches\": %llu}"
+                           : "%s%d,$%04X,%llu,%llu,%llu\n",
+                separator, page, page << 8, (unsigned long long)reads,
+                (unsigned long long)writes, (unsigned long long)fetches);
+        if (json)
+            separator = ",";
+    }
+
+    fprintf(file, json ? "\n], \"io\": [" : "\nio_register,reads,writes\n");
+    separator = "";
+    for (int reg = 0; reg < IO_REGISTER_COUNT; reg++) {
+        uint64_t reads = total(offsetof(BusStatsBlock, io_reads), reg);
+        uint64_t writes = total(offsetof(BusStatsBlock, io_writes), reg);
+        if (reads == 0 && writes == 0)
+            continue;
+        fprintf(file, json ? "%s\n  {\"address\": \"$%04X\", \"reads\": %llu, \"writes\": %llu}"
+                           : "%s$%04X,%llu,%llu\n",
+                separator, IO_REGISTERS_START + reg, (unsigned long long)reads,
+                (unsigned long long)writes);
+        if (json)
+            separator = ",";
+    }
+    if (json)
+        fprintf(file, "\n]}\n");
+    pthread_mutex_unlock(&blocks_lock);
+    fclose(file);
+    return 0;
+}
+
+#else
+
+int bus_stats_enable(const char *filename) {
+    (void)filename;
+    printf("Error: Built without bus statistics; rebuild with make BUS_STATS=1\n");
+    return -1;
+}
+
+int bus_stats_write(const char *filename) {
+    (void)filename;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef BUSSTATS_H
+#define BUSSTATS_H
+
+#include "../include/common.h"
+
+// Bus access heatmap, compiled in with -DBUS_STATS (make BUS_STATS=1).
+//
+// Counts reads and writes per 256-byte page, opcode fetches per page, and
+// reads and writes per I/O register. Reads cover every bus read, opcode
+// fetches included. Each thread counts into its own block, so there is no
+// contention and no atomic read-modify-write; blocks are summed when the
+// heatmap is written. Without BUS_STATS the hooks expand to nothing.
+
+#define IO_REGISTER_COUNT (IO_REGISTERS_END - IO_REGISTERS_START + 1)
+
+#ifdef BUS_STATS
+#include <signal.h>
+#include <stdatomic.h>
+
+typedef struct BusStatsBlock {
+    _Atomic uint64_t reads[MEMORY_PAGE_COUNT];
+    _Atomic uint64_t writes[MEMORY_PAGE_COUNT];
+    _Atomic uint64_t fetches[MEMORY_PAGE_COUNT];
+    _Atomic uint64_t io_reads[IO_REGISTER_COUNT];
+    _Atomic uint64_t io_writes[IO_REGISTER_COUNT];
+    struct BusStatsBlock *next;
+} BusStatsBlock;
+
+extern _Thread_local BusStatsBlock *bus_stats_block;
+extern atomic_int bus_stats_signalled;     // Lock-free, so safe to set from the handler
+
+BusStatsBlock *bus_stats_attach(void);
+void bus_stats_signal_dump(void);
+
+// Only the owning thread writes a counter, so a relaxed load and store
+// is enough for readers to see whole values
+static inline void bus_stats_bump(_Atomic uint64_t *counter) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+static inline BusStatsBlock *bus_stats(void) {
+    return bus_stats_block ? bus_stats_block : bus_stats_attach();
+}
+
+#define BUS_STATS_READ(address)     bus_stats_bump(&bus_stats()->reads[(address) >> 8])
+#define BUS_STATS_WRITE(address)    bus_stats_bump(&bus_stats()->writes[(address) >> 8])
+#define BUS_STATS_FETCH(address) do { \
+        bus_stats_bump(&bus_stats()->fetches[(address) >> 8]); \
+        if (atomic_load_explicit(&bus_stats_signalled, memory_order_relaxed)) \
+            bus_stats_signal_dump(); \
+    } while (0)
+#define BUS_STATS_IO_READ(address)  bus_stats_bump(&bus_stats()->io_reads[(address) - IO_REGISTERS_START])
+#define BUS_STATS_IO_WRITE(address) bus_stats_bump(&bus_stats()->io_writes[(address) - IO_REGISTERS_START])
+
+#else
+
+#define BUS_STATS_READ(address)     ((void)0)
+#define BUS_STATS_WRITE(address)    ((void)0)
+#define BUS_STATS_FETCH(address)    ((void)0)
+#define BUS_STATS_IO_READ(address)  ((void)0)
+#define BUS_STATS_IO_WRITE(address) ((void)0)
+
+#endif
+
+// Writes the heatmap to <filename> at exit and on SIGUSR1; CSV, or JSON
+// when the name ends in .json. Fails when built without BUS_STATS.
+int bus_stats_enable(const char *filename);
+int bus_stats_write(const char *filename);
+
+#endif
@@ -0,0 +1,234 @@
+#define _POSIX_C_SOURCE 200809L
+#include "cache.h"
+#include "memory.h"
+#include <string.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "6502RC1"
+#define CACHE_PATH_SIZE 4096
+
+typedef struct {
+    char magic[8];
+    CacheKey key;               // Guards against renamed or truncated entries
+    CacheKey digest;
+    uint64_t cycles;
+    uint64_t output_size;
+    uint16_t PC;
+    uint8_t A, X, Y, SP, status, is_running;
+} CacheRecord;
+
+static FILE *capture = NULL;
+static int saved_stdout = -1;
+
+static uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Final avalanche from MurmurHash3
+static uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+static void hash_word(CacheHash *hash, uint64_t word) {
+    hash->state[0] = (hash->state[0] ^ word) * 1099511628211ull;
+    hash->state[1] = rotate_left(hash->state[1] ^ (word * 0x9E3779B97F4A7C15ull), 31) *
+                     0xC2B2AE3D27D4EB4Full;
+}
+
+void cache_hash_init(CacheHash *hash) {
+    hash->state[0] = 14695981039346656037ull;
+    hash->state[1] = 0x27D4EB2F165667C5ull;
+    hash->length = 0;
+}
+
+// Eight bytes per step; a short tail is zero-padded and the total length
+// is folded in at the end
+void cache_hash_update(CacheHash *hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash_word(hash, word);
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        memcpy(&word, bytes + i, size - i);
+        hash_word(hash, word);
+    }
+    hash->length += size;
+}
+
+CacheKey cache_hash_final(const CacheHash *hash) {
+    CacheKey key;
+    key.lanes[0] = mix(hash->state[0] ^ hash->length);
+    key.lanes[1] = mix(hash->state[1] + key.lanes[0]);
+    return key;
+}
+
+CacheKey cache_memory_digest(void) {
+    CacheHash hash;
+    cache_hash_init(&hash);
+    for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+        uint16_t address = page * MEMORY_PAGE_SIZE;
+        uint8_t data[MEMORY_PAGE_SIZE];
+        if (current_bus->read_pages[page]) {
+            cache_hash_update(&hash, current_bus->read_pages[page], MEMORY_PAGE_SIZE);
+        } else if (address >= ROM_START && current_bus->rom) {
+            cache_hash_update(&hash, current_bus->rom + (address - ROM_START), MEMORY_PAGE_SIZE);
+        } else {
+            // Unmapped and I/O pages are not memory
+            memset(data, 0, sizeof(data));
+            cache_hash_update(&hash, data, MEMORY_PAGE_SIZE);
+        }
+    }
+    return cache_hash_final(&hash);
+}
+
+// Hash of the running executable, so a rebuilt emulator never replays
+// results recorded by another build. Falls back to the compile time when
+// the executable cannot be read.
+CacheKey cache_build_digest(void) {
+    static const char build_time[] = __DATE__ " " __TIME__;
+    CacheHash hash;
+    cache_hash_init(&hash);
+
+    FILE *file = fopen("/proc/self/exe", "rb");
+    if (file == NULL) {
+        cache_hash_update(&hash, build_time, sizeof(build_time));
+        return cache_hash_final(&hash);
+    }
+    uint8_t buffer[1 << 16];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        cache_hash_update(&hash, buffer, size);
+    fclose(file);
+    return cache_hash_final(&hash);
+}
+
+void cache_print_key(FILE *out, CacheKey key) {
+    fprintf(out, "%016llx%016llx", (unsigned long long)key.lanes[0],
+            (unsigned long long)key.lanes[1]);
+}
+
+static void entry_path(char *path, const char *directory, CacheKey key) {
+    snprintf(path, CACHE_PATH_SIZE, "%s/%016llx%016llx.result", directory,
+             (unsigned long long)key.lanes[0], (unsigned long long)key.lanes[1]);
+}
+
+int cache_lookup(const char *directory, CacheKey key, CPU *cpu, CacheKey *digest) {
+    char path[CACHE_PATH_SIZE];
+    CacheRecord record;
+
+    entry_path(path, directory, key);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+    if (fread(&record, sizeof(record), 1, file) != 1 ||
+        memcmp(record.magic, CACHE_MAGIC, sizeof(record.magic)) != 0 ||
+        memcmp(&record.key, &key, sizeof(key)) != 0) {
+        fclose(file);
+        return 0;
+    }
+
+    // Copy the recorded output through, checking it is all there first
+    char *output = malloc(record.output_size ? record.output_size : 1);
+    if (output == NULL || fread(output, 1, record.output_size, file) != record.output_size) {
+        free(output);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    fwrite(output, 1, record.output_size, stdout);
+    free(output);
+
+    cpu->A = record.A;
+    cpu->X = record.X;
+    cpu->Y = record.Y;
+    cpu->SP = record.SP;
+    cpu->status = record.status;
+    cpu->PC = record.PC;
+    cpu->is_running = record.is_running;
+    cpu->cycles = record.cycles;
+    *digest = record.digest;
+    return 1;
+}
+
+int cache_capture_begin(void) {
+    fflush(stdout);
+    capture = tmpfile();
+    if (capture == NULL || (saved_stdout = dup(STDOUT_FILENO)) < 0 ||
+        dup2(fileno(capture), STDOUT_FILENO) < 0) {
+        printf("Error: Unable to capture output for the result cache\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Restores stdout and returns what the run wrote, echoed to the real stdout
+static char *capture_end(size_t *size) {
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    saved_stdout = -1;
+
+    long length = ftell(capture);
+    char *output = malloc(length > 0 ? length : 1);
+    rewind(capture);
+    *size = output ? fread(output, 1, length, capture) : 0;
+    fclose(capture);
+    capture = NULL;
+    if (output)
+        fwrite(output, 1, *size, stdout);
+    return output;
+}
+
+int cache_store(const char *directory, CacheKey key, const CPU *cpu, CacheKey digest) {
+    char path[CACHE_PATH_SIZE];
+    char temporary[CACHE_PATH_SIZE + 32];
+    size_t size;
+    char *output = capture_end(&size);
+    if (output == NULL) {
+        printf("Error: Out of memory recording output for the result cache\n");
+        return -1;
+    }
+
+    CacheRecord record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.magic, CACHE_MAGIC, sizeof(record.magic));
+    record.key = key;
+    record.digest = digest;
+    record.cycles = cpu->cycles;
+    record.output_size = size;
+    record.PC = cpu->PC;
+    record.A = cpu->A;
+    record.X = cpu->X;
+    record.Y = cpu->Y;
+    record.SP = cpu->SP;
+    record.status = cpu->status;
+    record.is_running = cpu->is_running;
+
+    // Written aside and renamed into place, so concurrent runners never
+    // read a partial entry
+    entry_path(path, directory, key);
+    snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", path, (long)getpid());
+    FILE *file = fopen(temporary, "wb");
+    int ok = file != NULL &&
+             fwrite(&record, sizeof(record), 1, file) == 1 &&
+             fwrite(output, 1, size, file) == size;
+    if (file && fclose(file) != 0)
+        ok = 0;
+    free(output);
+    if (!ok || rename(temporary, path) != 0) {
+        remove(temporary);
+        fprintf(stderr, "Warning: Unable to write result cache entry %s\n", path);
+        return -1;
+    }
+    return 0;
+}
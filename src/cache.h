@@ -0,0 +1,45 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "cpu.h"
+
+// Content-addressed cache of single-machine run results.
+//
+// The key is a 128-bit hash of everything a run depends on: the emulator
+// build, the engine, the attached devices, the initial CPU state, the whole
+// RAM and ROM image (which covers the load address) and the recorded
+// console input. An entry
+// holds the final CPU, a digest of the final RAM and ROM and every byte the
+// run wrote to stdout, so a hit reproduces the run's output exactly.
+
+typedef struct {
+    uint64_t lanes[2];
+} CacheKey;
+
+typedef struct {
+    uint64_t state[2];
+    uint64_t length;
+} CacheHash;
+
+void cache_hash_init(CacheHash *hash);
+void cache_hash_update(CacheHash *hash, const void *data, size_t size);
+CacheKey cache_hash_final(const CacheHash *hash);
+
+// Hash of the current bus RAM and ROM
+CacheKey cache_memory_digest(void);
+
+// Identifies the emulator build, part of every key
+CacheKey cache_build_digest(void);
+
+// Returns 1 and fills <cpu> and <digest> on a hit, replaying the recorded
+// output to stdout; 0 on a miss
+int cache_lookup(const char *directory, CacheKey key, CPU *cpu, CacheKey *digest);
+
+// Brackets a run whose stdout is to be recorded: cache_store() ends the
+// capture, echoes the output and writes the entry
+int cache_capture_begin(void);
+int cache_store(const char *directory, CacheKey key, const CPU *cpu, CacheKey digest);
+
+void cache_print_key(FILE *out, CacheKey key);
+
+#endif
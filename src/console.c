@@ -0,0 +1,62 @@
+#include "console.h"
+#include "memory.h"
+#include <string.h>
+
+static uint8_t console_read(void *context, uint16_t address) {
+    Console *console = context;
+
+    if ((address - console->base) % CONSOLE_REGISTER_COUNT == CONSOLE_STATUS) {
+        return console->input_position < console->input_size
+                   ? CONSOLE_STATUS_INPUT : CONSOLE_STATUS_END;
+    }
+    if (console->input_position < console->input_size)
+        return console->input[console->input_position++];
+    return 0;
+}
+
+static void console_write(void *context, uint16_t address, uint8_t value) {
+    Console *console = context;
+
+    if ((address - console->base) % CONSOLE_REGISTER_COUNT != CONSOLE_DATA)
+        return;
+    putchar(value);
+    console->bytes_written++;
+}
+
+int console_attach(Console *console, uint16_t base) {
+    memset(console, 0, sizeof(*console));
+    console->base = base;
+
+    IoDevice device = { base, base + CONSOLE_REGISTER_COUNT - 1, console_read, console_write, console };
+    return register_io_device(&device);
+}
+
+int console_load_input(Console *console, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        printf("Error: Unable to open input file %s\n", filename);
+        return -1;
+    }
+
+    size_t capacity = 4096;
+    console->input = malloc(capacity);
+    console->input_size = 0;
+    while (console->input) {
+        console->input_size += fread(console->input + console->input_size, 1,
+                                     capacity - console->input_size, file);
+        if (console->input_size < capacity)
+            break;
+        capacity *= 2;
+        uint8_t *grown = realloc(console->input, capacity);
+        if (grown == NULL)
+            free(console->input);
+        console->input = grown;
+    }
+    fclose(file);
+    if (console->input == NULL) {
+        printf("Error: Out of memory reading input file %s\n", filename);
+        return -1;
+    }
+    console->input_position = 0;
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "../include/common.h"
+
+// Character console in the I/O register range. Reads of CONSOLE_DATA
+// consume a recorded input stream loaded up front, so a run is a pure
+// function of its image and input; writes go to stdout.
+
+#define CONSOLE_DEFAULT_BASE 0x2300
+
+#define CONSOLE_DATA       0x00   // Read: next input byte (0 at end); write: output byte
+#define CONSOLE_STATUS     0x01
+#define CONSOLE_REGISTER_COUNT 0x02
+
+#define CONSOLE_STATUS_INPUT  0x01   // Input byte available
+#define CONSOLE_STATUS_END    0x80   // Input stream exhausted
+
+typedef struct {
+    uint16_t base;
+    uint8_t *input;
+    size_t input_size;
+    size_t input_position;
+    uint64_t bytes_written;
+} Console;
+
+int console_attach(Console *console, uint16_t base);
+int console_load_input(Console *console, const char *filename);
+
+#endif
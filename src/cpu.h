@@ -1,32 +1,14 @@
 #ifndef CPU_H
 #define CPU_H
 
-#include "../include/common.h"
-
-#define FLAG_NEGATIVE     0x80
-#define FLAG_OVERFLOW     0x40
-#define FLAG_UNUSED       0x20
-#define FLAG_BREAK        0x10
-#define FLAG_DECIMAL      0x08
-#define FLAG_INTERRUPT    0x04
-#define FLAG_ZERO         0x02
-#define FLAG_CARRY        0x01
-
-
-typedef struct {
-    uint8_t A;        
-    uint8_t X;       
-    uint8_t Y;        
-    uint8_t SP;      
-    uint8_t status;   
-    uint16_t PC;     
-    uint8_t is_running; 
-} CPU;
+#include "cpu_state.h"
 
 void reset_cpu(CPU * cpu);
 uint8_t fetch(CPU * cpu, uint8_t * memory);
 void execute(CPU *cpu, uint8_t * memory);
+void execute_opcode(CPU *cpu, uint8_t *memory, uint8_t opcode);
 void load_program(const char *filename, uint16_t load_address);
+void update_zero_and_negative_flags(CPU *cpu, uint8_t value);
 
 void lda_immediate(CPU *cpu, uint8_t *memory);
 void lda_zero_page(CPU *cpu, uint8_t *memory);
@@ -40,6 +22,11 @@ void sty_zero_page(CPU *cpu, uint8_t *memory);
 // Arithmetic Operations
 void adc_immediate(CPU *cpu, uint8_t *memory);
 void sbc_immediate(CPU *cpu, uint8_t *memory);
+void adc_immediate_binary(CPU *cpu, uint8_t *memory);
+void sbc_immediate_binary(CPU *cpu, uint8_t *memory);
+void adc_immediate_cmos(CPU *cpu, uint8_t *memory);
+void sbc_immediate_cmos(CPU *cpu, uint8_t *memory);
+void init_decimal_tables(void);
 void cmp_immediate(CPU *cpu, uint8_t *memory);
 void cpx_immediate(CPU *cpu, uint8_t *memory);
 void cpy_immediate(CPU *cpu, uint8_t *memory);
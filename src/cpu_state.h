@@ -0,0 +1,31 @@
+#ifndef CPU_STATE_H
+#define CPU_STATE_H
+
+#include "../include/common.h"
+
+// Register file and status flags, without the handler prototypes, so
+// the handlers can also be compiled static into a host
+// (include/mos6502_inline.h).
+
+#define FLAG_NEGATIVE     0x80
+#define FLAG_OVERFLOW     0x40
+#define FLAG_UNUSED       0x20
+#define FLAG_BREAK        0x10
+#define FLAG_DECIMAL      0x08
+#define FLAG_INTERRUPT    0x04
+#define FLAG_ZERO         0x02
+#define FLAG_CARRY        0x01
+
+
+typedef struct {
+    uint8_t A;        
+    uint8_t X;       
+    uint8_t Y;        
+    uint8_t SP;      
+    uint8_t status;   
+    uint16_t PC;     
+    uint8_t is_running; 
+    uint64_t cycles;    // Base cycles of retired instructions plus bus stalls
+} CPU;
+
+#endif
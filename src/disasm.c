@@ -0,0 +1,294 @@
+#include "disasm.h"
+#include "opcodes.h"
+#include <string.h>
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static char *put_hex8(char *out, uint8_t value) {
+    out[0] = hex_digits[value >> 4];
+    out[1] = hex_digits[value & 0x0F];
+    return out + 2;
+}
+
+static char *put_hex16(char *out, uint16_t value) {
+    return put_hex8(put_hex8(out, value >> 8), value & 0xFF);
+}
+
+static char *put_text(char *out, const char *text) {
+    while (*text)
+        *out++ = *text++;
+    return out;
+}
+
+static int is_flow_end(uint8_t opcode) {
+    return opcode == 0x4C || opcode == 0x6C || opcode == 0x60 || opcode == 0x40 ||
+           opcode == 0x00 || strcmp(nmos_opcode_table[opcode].mnemonic, "JAM") == 0;
+}
+
+// Absolute operands that name a location rather than a value
+static int is_absolute_reference(uint8_t mode) {
+    return mode == MODE_ABSOLUTE || mode == MODE_ABSOLUTE_X ||
+           mode == MODE_ABSOLUTE_Y || mode == MODE_INDIRECT;
+}
+
+static uint16_t instruction_target(const uint8_t *bytes, uint16_t address) {
+    const OpcodeDescriptor *info = &nmos_opcode_table[bytes[0]];
+    if (info->mode == MODE_RELATIVE)
+        return address + 2 + (int8_t)bytes[1];
+    return bytes[1] | (bytes[2] << 8);
+}
+
+// Writes "MNE operand" for the instruction at <bytes>; <label> replaces
+// the address of absolute and relative operands when non-NULL
+static char *put_instruction(char *out, const uint8_t *bytes, uint16_t address,
+                             const char *label) {
+    const OpcodeDescriptor *info = &nmos_opcode_table[bytes[0]];
+    uint16_t target = instruction_target(bytes, address);
+
+    out = put_text(out, info->mnemonic);
+    if (info->mode == MODE_IMPLIED)
+        return out;
+    *out++ = ' ';
+
+    switch (info->mode) {
+        case MODE_ACCUMULATOR:
+            *out++ = 'A';
+            break;
+        case MODE_IMMEDIATE:
+            out = put_hex8(put_text(out, "#$"), bytes[1]);
+            break;
+        case MODE_ZERO_PAGE:
+            out = put_hex8(put_text(out, "$"), bytes[1]);
+            break;
+        case MODE_ZERO_PAGE_X:
+            out = put_text(put_hex8(put_text(out, "$"), bytes[1]), ",X");
+            break;
+        case MODE_ZERO_PAGE_Y:
+            out = put_text(put_hex8(put_text(out, "$"), bytes[1]), ",Y");
+            break;
+        case MODE_INDEXED_INDIRECT:
+            out = put_text(put_hex8(put_text(out, "($"), bytes[1]), ",X)");
+            break;
+        case MODE_INDIRECT_INDEXED:
+            out = put_text(put_hex8(put_text(out, "($"), bytes[1]), "),Y");
+            break;
+        case MODE_ZERO_PAGE_INDIRECT:
+            out = put_text(put_hex8(put_text(out, "($"), bytes[1]), ")");
+            break;
+        default:
+            if (info->mode == MODE_INDIRECT)
+                *out++ = '(';
+            out = label ? put_text(out, label) : put_hex16(put_text(out, "$"), target);
+            if (info->mode == MODE_INDIRECT)
+                *out++ = ')';
+            else if (info->mode == MODE_ABSOLUTE_X)
+                out = put_text(out, ",X");
+            else if (info->mode == MODE_ABSOLUTE_Y)
+                out = put_text(out, ",Y");
+            break;
+    }
+    return out;
+}
+
+int disasm_instruction(const uint8_t *bytes, uint16_t address, char *out, size_t size) {
+    char line[DISASM_MAX_LINE];
+
+    *put_instruction(line, bytes, address, NULL) = '\0';
+    snprintf(out, size, "%s", line);
+    return nmos_opcode_table[bytes[0]].length;
+}
+
+void disasm_init(Disassembly *disassembly) {
+    memset(disassembly->image, 0, sizeof(disassembly->image));
+    memset(disassembly->flags, 0, sizeof(disassembly->flags));
+    disassembly->worklist_size = 0;
+}
+
+void disasm_load(Disassembly *disassembly, const uint8_t *data, size_t size, uint16_t address) {
+    for (size_t i = 0; i < size && address + i < MEMORY_SIZE; i++) {
+        disassembly->image[address + i] = data[i];
+        disassembly->flags[address + i] |= DISASM_LOADED;
+    }
+}
+
+// Instructions are only decoded over loaded bytes no other instruction
+// has claimed, so overlapping decodes never reach the listing
+static int decodable(const Disassembly *disassembly, uint16_t address) {
+    const OpcodeDescriptor *info = &nmos_opcode_table[disassembly->image[address]];
+    for (int i = 0; i < info->length; i++) {
+        uint8_t flags = disassembly->flags[(uint16_t)(address + i)];
+        if (!(flags & DISASM_LOADED) || (flags & (DISASM_CODE | DISASM_OPERAND)))
+            return 0;
+    }
+    return 1;
+}
+
+static void mark_instruction(Disassembly *disassembly, uint16_t address) {
+    const OpcodeDescriptor *info = &nmos_opcode_table[disassembly->image[address]];
+    disassembly->flags[address] |= DISASM_CODE;
+    for (int i = 1; i < info->length; i++)
+        disassembly->flags[(uint16_t)(address + i)] |= DISASM_OPERAND;
+}
+
+static void push_target(Disassembly *disassembly, uint16_t address, uint8_t label) {
+    uint8_t flags = disassembly->flags[address];
+    disassembly->flags[address] |= label | DISASM_QUEUED;
+    if (!(flags & (DISASM_CODE | DISASM_QUEUED)))
+        disassembly->worklist[disassembly->worklist_size++] = address;
+}
+
+void disasm_trace(Disassembly *disassembly, uint16_t entry) {
+    push_target(disassembly, entry, DISASM_LABEL);
+
+    while (disassembly->worklist_size > 0) {
+        uint16_t address = disassembly->worklist[--disassembly->worklist_size];
+
+        while (decodable(disassembly, address)) {
+            uint8_t bytes[3];
+            for (int i = 0; i < 3; i++)
+                bytes[i] = disassembly->image[(uint16_t)(address + i)];
+            const OpcodeDescriptor *info = &nmos_opcode_table[bytes[0]];
+            uint16_t target = instruction_target(bytes, address);
+
+            mark_instruction(disassembly, address);
+            if (info->mode == MODE_RELATIVE || bytes[0] == 0x4C) {
+                push_target(disassembly, target, DISASM_LABEL);
+            } else if (bytes[0] == 0x20) {
+                push_target(disassembly, target, DISASM_SUBROUTINE);
+            } else if (is_absolute_reference(info->mode) &&
+                       (disassembly->flags[target] & DISASM_LOADED)) {
+                disassembly->flags[target] |= DISASM_DATA_LABEL;
+            }
+            if (is_flow_end(bytes[0]))
+                break;
+            address += info->length;
+        }
+    }
+}
+
+void disasm_trace_vectors(Disassembly *disassembly) {
+    for (int vector = 0xFFFA; vector <= 0xFFFE; vector += 2) {
+        if ((disassembly->flags[vector] & DISASM_LOADED) &&
+            (disassembly->flags[vector + 1] & DISASM_LOADED))
+            disasm_trace(disassembly, disassembly->image[vector] |
+                                      (disassembly->image[vector + 1] << 8));
+    }
+}
+
+// Plain linear sweep: every decodable byte not yet claimed starts an instruction
+void disasm_mark_linear(Disassembly *disassembly, uint16_t first, uint16_t last) {
+    for (int address = first; address <= last;) {
+        if (decodable(disassembly, address)) {
+            mark_instruction(disassembly, address);
+            address += nmos_opcode_table[disassembly->image[address]].length;
+        } else {
+            address++;
+        }
+    }
+}
+
+void disasm_flush(DisasmOutput *output) {
+    if (output->used > 0)
+        fwrite(output->buffer, 1, output->used, output->file);
+    output->used = 0;
+}
+
+// Labels name instruction starts and data bytes, never operand bytes
+static int has_label(const Disassembly *disassembly, uint16_t address) {
+    uint8_t flags = disassembly->flags[address];
+    return (flags & (DISASM_LABEL | DISASM_SUBROUTINE | DISASM_DATA_LABEL)) &&
+           (flags & DISASM_LOADED) && !(flags & DISASM_OPERAND);
+}
+
+static char *put_label(char *out, const Disassembly *disassembly, uint16_t address) {
+    uint8_t flags = disassembly->flags[address];
+    *out++ = flags & DISASM_SUBROUTINE ? 'S' : flags & DISASM_LABEL ? 'L' : 'D';
+    return put_hex16(out, address);
+}
+
+static char *put_code_line(char *out, const Disassembly *disassembly, uint16_t address) {
+    uint8_t bytes[3];
+    for (int i = 0; i < 3; i++)
+        bytes[i] = disassembly->image[(uint16_t)(address + i)];
+    const OpcodeDescriptor *info = &nmos_opcode_table[bytes[0]];
+    char label[8];
+    const char *operand_label = NULL;
+
+    out = put_hex16(put_text(out, "  "), address);
+    out = put_text(out, "  ");
+    // Bytes column: "A9 01 02" padded to 8
+    for (int i = 0; i < 3; i++) {
+        if (i < info->length) {
+            out = put_hex8(out, bytes[i]);
+        } else {
+            *out++ = ' ';
+            *out++ = ' ';
+        }
+        *out++ = ' ';
+    }
+    *out++ = ' ';
+    *out++ = ' ';
+
+    if (info->mode == MODE_RELATIVE || is_absolute_reference(info->mode)) {
+        uint16_t target = instruction_target(bytes, address);
+        if (has_label(disassembly, target)) {
+            *put_label(label, disassembly, target) = '\0';
+            operand_label = label;
+        }
+    }
+    out = put_instruction(out, bytes, address, operand_label);
+    *out++ = '\n';
+    return out;
+}
+
+static int is_data(const Disassembly *disassembly, uint16_t address) {
+    uint8_t flags = disassembly->flags[address];
+    return (flags & DISASM_LOADED) && !(flags & (DISASM_CODE | DISASM_OPERAND));
+}
+
+// Returns the number of data bytes listed, at most 8 per line
+static int put_data_line(char **out, const Disassembly *disassembly, uint16_t address, int limit) {
+    char *p = put_hex16(put_text(*out, "  "), address);
+    int count = 0;
+
+    p = put_text(p, "  .byte ");
+    do {
+        if (count > 0)
+            *p++ = ',';
+        p = put_hex8(put_text(p, "$"), disassembly->image[(uint16_t)(address + count)]);
+        count++;
+    } while (count < 8 && count < limit && is_data(disassembly, address + count) &&
+             !has_label(disassembly, address + count));
+    *p++ = '\n';
+    *out = p;
+    return count;
+}
+
+void disasm_list(const Disassembly *disassembly, uint16_t first, uint16_t last,
+                 DisasmOutput *output) {
+    int address = first;
+
+    while (address <= last) {
+        uint8_t flags = disassembly->flags[address];
+        if (!(flags & DISASM_LOADED) || (flags & DISASM_OPERAND)) {
+            address++;
+            continue;
+        }
+        if (output->used + 2 * DISASM_MAX_LINE > DISASM_BUFFER_SIZE)
+            disasm_flush(output);
+
+        char *out = output->buffer + output->used;
+        if (has_label(disassembly, address)) {
+            out = put_label(out, disassembly, address);
+            *out++ = ':';
+            *out++ = '\n';
+        }
+        if (flags & DISASM_CODE) {
+            out = put_code_line(out, disassembly, address);
+            address += nmos_opcode_table[disassembly->image[address]].length;
+        } else {
+            address += put_data_line(&out, disassembly, address, last - address + 1);
+        }
+        output->used = out - output->buffer;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include "../include/common.h"
+
+// Table-driven disassembler over the NMOS opcode descriptions (nmos.def),
+// which cover all 256 opcodes as the silicon decodes them.
+//
+// An image is loaded into a 64 KB address space, traced from its entry
+// points to separate code from data (recursive descent over branches,
+// jumps and calls), then listed with generated labels: Lxxxx for jump and
+// branch targets, Sxxxx for subroutines and Dxxxx for data referenced by
+// absolute operands. Output is formatted by hand into a large buffer.
+
+#define DISASM_CODE        0x01   // First byte of a traced instruction
+#define DISASM_OPERAND     0x02   // Operand byte of a traced instruction
+#define DISASM_LABEL       0x04   // Branch or jump target
+#define DISASM_SUBROUTINE  0x08   // JSR target
+#define DISASM_DATA_LABEL  0x10   // Referenced by an absolute operand
+#define DISASM_QUEUED      0x40   // Pushed on the trace worklist
+#define DISASM_LOADED      0x80
+
+#define DISASM_MAX_LINE    64     // Longest formatted line, newline included
+#define DISASM_BUFFER_SIZE (1 << 16)
+
+typedef struct {
+    uint8_t image[MEMORY_SIZE];
+    uint8_t flags[MEMORY_SIZE];
+    uint16_t worklist[MEMORY_SIZE];
+    int worklist_size;
+} Disassembly;
+
+typedef struct {
+    FILE *file;
+    size_t used;
+    char buffer[DISASM_BUFFER_SIZE];
+} DisasmOutput;
+
+// Formats the instruction at <bytes> as "MNE operand" without labels;
+// returns its length
+int disasm_instruction(const uint8_t *bytes, uint16_t address, char *out, size_t size);
+
+void disasm_init(Disassembly *disassembly);
+void disasm_load(Disassembly *disassembly, const uint8_t *data, size_t size, uint16_t address);
+void disasm_trace(Disassembly *disassembly, uint16_t entry);
+void disasm_trace_vectors(Disassembly *disassembly);
+void disasm_mark_linear(Disassembly *disassembly, uint16_t first, uint16_t last);
+void disasm_list(const Disassembly *disassembly, uint16_t first, uint16_t last,
+                 DisasmOutput *output);
+void disasm_flush(DisasmOutput *output);
+
+#endif
@@ -0,0 +1,160 @@
+#include "dma.h"
+#include "memory.h"
+#include "metrics.h"
+#include <string.h>
+
+// Bus cycles per byte on a typical 6502 system DMA (read + write for copies)
+#define DMA_SETUP_CYCLES    4
+#define DMA_COPY_CYCLES     2
+#define DMA_FILL_CYCLES     1
+#define DMA_COMPARE_CYCLES  2
+
+static uint16_t dma_word(DmaController *dma, int low) {
+    return dma->registers[low] | (dma->registers[low + 1] << 8);
+}
+
+// Bytes from address up to the end of its page, capped at remaining
+static uint32_t page_span(uint16_t address, uint32_t remaining) {
+    uint32_t span = MEMORY_PAGE_SIZE - (address & 0xFF);
+    return span < remaining ? span : remaining;
+}
+
+static uint8_t dma_copy(uint16_t source, uint16_t dest, uint32_t length) {
+    uint8_t status = DMA_STATUS_DONE;
+
+    while (length > 0) {
+        uint32_t chunk = page_span(dest, page_span(source, length));
+        uint8_t *from = current_bus->read_pages[source >> 8];
+        uint8_t *to = current_bus->write_pages[dest >> 8];
+
+        if (from && to) {
+            from += source & 0xFF;
+            to += dest & 0xFF;
+            if (to + chunk <= from || from + chunk <= to || to <= from) {
+                memmove(to, from, chunk);
+            } else { // Overlapping forward copy replicates, as a guest loop would
+                for (uint32_t i = 0; i < chunk; i++)
+                    to[i] = from[i];
+            }
+        } else if (!to && dest >= ROM_START) {
+            status |= DMA_STATUS_ERROR;
+        } else {
+            for (uint32_t i = 0; i < chunk; i++)
+                write_memory(dest + i, read_memory(source + i));
+        }
+        source += chunk;
+        dest += chunk;
+        length -= chunk;
+    }
+    return status;
+}
+
+static uint8_t dma_fill(uint16_t dest, uint32_t length, uint8_t value) {
+    uint8_t status = DMA_STATUS_DONE;
+
+    while (length > 0) {
+        uint32_t chunk = page_span(dest, length);
+        uint8_t *to = current_bus->write_pages[dest >> 8];
+
+        if (to) {
+            memset(to + (dest & 0xFF), value, chunk);
+        } else if (dest >= ROM_START) {
+            status |= DMA_STATUS_ERROR;
+        } else {
+            for (uint32_t i = 0; i < chunk; i++)
+                write_memory(dest + i, value);
+        }
+        dest += chunk;
+        length -= chunk;
+    }
+    return status;
+}
+
+static uint8_t dma_compare(uint16_t source, uint16_t dest, uint32_t length, uint16_t *result) {
+    uint32_t offset = 0;
+
+    while (offset < length) {
+        uint16_t x = source + offset, y = dest + offset;
+        uint32_t chunk = page_span(y, page_span(x, length - offset));
+        uint8_t *left = current_bus->read_pages[x >> 8];
+        uint8_t *right = current_bus->read_pages[y >> 8];
+
+        if (left && right && memcmp(left + (x & 0xFF), right + (y & 0xFF), chunk) == 0) {
+            offset += chunk;
+            continue;
+        }
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (read_memory(x + i) != read_memory(y + i)) {
+                *result = offset + i;
+                return DMA_STATUS_DONE | DMA_STATUS_MISMATCH;
+            }
+        }
+        offset += chunk;
+    }
+    *result = length;
+    return DMA_STATUS_DONE;
+}
+
+static void dma_run(DmaController *dma, uint8_t command) {
+    uint16_t source = dma_word(dma, DMA_SOURCE_LO);
+    uint16_t dest = dma_word(dma, DMA_DEST_LO);
+    uint32_t length = dma_word(dma, DMA_LENGTH_LO);
+    uint16_t result = 0;
+    uint8_t status;
+    int per_byte;
+
+    switch (command) {
+        case DMA_CMD_COPY:
+            status = dma_copy(source, dest, length);
+            per_byte = DMA_COPY_CYCLES;
+            break;
+        case DMA_CMD_FILL:
+            status = dma_fill(dest, length, dma->registers[DMA_FILL]);
+            per_byte = DMA_FILL_CYCLES;
+            break;
+        case DMA_CMD_COMPARE:
+            status = dma_compare(source, dest, length, &result);
+            length = result < length ? (uint32_t)result + 1 : length;
+            per_byte = DMA_COMPARE_CYCLES;
+            break;
+        default:
+            dma->registers[DMA_STATUS] = DMA_STATUS_DONE | DMA_STATUS_ERROR;
+            return;
+    }
+
+    dma->registers[DMA_STATUS] = status;
+    dma->registers[DMA_RESULT_LO] = result & 0xFF;
+    dma->registers[DMA_RESULT_HI] = result >> 8;
+    dma->bytes_moved += length;
+    if (dma->charge_cycles && dma->cpu) {
+        uint64_t stall = DMA_SETUP_CYCLES + (uint64_t)per_byte * length;
+        dma->cpu->cycles += stall;
+        METRICS_ADD(stall_cycles, stall);
+    }
+}
+
+static uint8_t dma_read(void *context, uint16_t address) {
+    DmaController *dma = context;
+    return dma->registers[(address - dma->base) % DMA_REGISTER_COUNT];
+}
+
+static void dma_write(void *context, uint16_t address, uint8_t value) {
+    DmaController *dma = context;
+    int reg = (address - dma->base) % DMA_REGISTER_COUNT;
+
+    if (reg == DMA_STATUS || reg == DMA_RESULT_LO || reg == DMA_RESULT_HI)
+        return;
+    dma->registers[reg] = value;
+    if (reg == DMA_COMMAND)
+        dma_run(dma, value);
+}
+
+int dma_attach(DmaController *dma, CPU *cpu, uint16_t base, int charge_cycles) {
+    memset(dma, 0, sizeof(*dma));
+    dma->cpu = cpu;
+    dma->base = base;
+    dma->charge_cycles = charge_cycles;
+
+    IoDevice device = { base, base + DMA_REGISTER_COUNT - 1, dma_read, dma_write, dma };
+    return register_io_device(&device);
+}
@@ -0,0 +1,47 @@
+#ifndef DMA_H
+#define DMA_H
+
+#include "cpu.h"
+
+// Block copy/fill/compare controller in the I/O register range.
+//
+// Writing DMA_COMMAND runs the transfer to completion before the next
+// instruction, as a halting DMA would. Copies go forward byte by byte in
+// effect, so overlapping copies behave like the equivalent guest loop.
+// Writes into ROM are dropped and flagged; I/O registers are accessed one
+// byte at a time through the bus.
+
+#define DMA_DEFAULT_BASE 0x2100
+
+#define DMA_SOURCE_LO    0x00
+#define DMA_SOURCE_HI    0x01
+#define DMA_DEST_LO      0x02
+#define DMA_DEST_HI      0x03
+#define DMA_LENGTH_LO    0x04
+#define DMA_LENGTH_HI    0x05
+#define DMA_FILL         0x06
+#define DMA_COMMAND      0x07   // Write: start; read: last command
+#define DMA_STATUS       0x08
+#define DMA_RESULT_LO    0x09   // Compare: offset of the first difference
+#define DMA_RESULT_HI    0x0A
+#define DMA_REGISTER_COUNT 0x10
+
+#define DMA_CMD_COPY     0x01
+#define DMA_CMD_FILL     0x02
+#define DMA_CMD_COMPARE  0x03
+
+#define DMA_STATUS_DONE      0x01
+#define DMA_STATUS_MISMATCH  0x40
+#define DMA_STATUS_ERROR     0x80   // ROM write or unknown command
+
+typedef struct {
+    CPU *cpu;               // Charged for transfers when charge_cycles is set
+    int charge_cycles;
+    uint16_t base;
+    uint8_t registers[DMA_REGISTER_COUNT];
+    uint64_t bytes_moved;
+} DmaController;
+
+int dma_attach(DmaController *dma, CPU *cpu, uint16_t base, int charge_cycles);
+
+#endif
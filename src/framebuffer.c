@@ -0,0 +1,299 @@
+#include "framebuffer.h"
+#include "memory.h"
+#include <string.h>
+
+// Raw stream layout, all integers little-endian:
+//   header: "6502FB1\0", width (2), height (2), tile size (2)
+//   frame:  frame number (8), dirty bitmap (8), then the pixels of each
+//           set tile in bit order, row by row
+#define FB_RAW_MAGIC "6502FB1"
+
+#define PNG_ROW_SIZE   (1 + FB_WIDTH)                  // Filter byte + pixels
+#define PNG_DATA_SIZE  (PNG_ROW_SIZE * FB_HEIGHT)
+#define PNG_MAX_SIZE   (8 + 25 + 12 + 768 + 12 + 2 + 5 + PNG_DATA_SIZE + 4 + 12)
+
+static uint32_t crc_table[256];
+
+static void init_crc_table(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t png_crc(const uint8_t *data, size_t size) {
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+        c = crc_table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+static uint8_t *put_be32(uint8_t *out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+    return out + 4;
+}
+
+static void put_le(uint8_t *out, uint64_t value, int size) {
+    for (int i = 0; i < size; i++)
+        out[i] = value >> (8 * i);
+}
+
+// Chunk data must already be at out + 8; fills in length, type and CRC
+static uint8_t *finish_chunk(uint8_t *out, const char *type, uint32_t size) {
+    put_be32(out, size);
+    memcpy(out + 4, type, 4);
+    return put_be32(out + 8 + size, png_crc(out + 4, size + 4));
+}
+
+// Indexed PNG with an RGB332 palette; the image data is one stored
+// (uncompressed) deflate block, which keeps encoding a straight copy
+static size_t encode_png(const uint8_t *pixels, uint8_t *png) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t *out = png;
+
+    memcpy(out, signature, sizeof(signature));
+    out += sizeof(signature);
+
+    uint8_t *data = out + 8;
+    data = put_be32(data, FB_WIDTH);
+    data = put_be32(data, FB_HEIGHT);
+    memcpy(data, "\x08\x03\x00\x00\x00", 5);   // 8-bit indexed, no interlace
+    out = finish_chunk(out, "IHDR", 13);
+
+    data = out + 8;
+    for (int i = 0; i < 256; i++) {
+        *data++ = ((i >> 5) & 7) * 255 / 7;
+        *data++ = ((i >> 2) & 7) * 255 / 7;
+        *data++ = (i & 3) * 255 / 3;
+    }
+    out = finish_chunk(out, "PLTE", 768);
+
+    data = out + 8;
+    uint8_t *zlib = data;
+    *data++ = 0x78;
+    *data++ = 0x01;
+    *data++ = 0x01;                             // Final stored block
+    put_le(data, PNG_DATA_SIZE, 2);
+    put_le(data + 2, ~PNG_DATA_SIZE & 0xFFFF, 2);
+    data += 4;
+    uint32_t a = 1, b = 0;
+    for (int y = 0; y < FB_HEIGHT; y++) {
+        *data++ = 0;                            // Filter: none
+        memcpy(data, pixels + y * FB_WIDTH, FB_WIDTH);
+        b = (b + a) % 65521;                    // Filter byte
+        for (int x = 0; x < FB_WIDTH; x++) {
+            a = (a + data[x]) % 65521;
+            b = (b + a) % 65521;
+        }
+        data += FB_WIDTH;
+    }
+    data = put_be32(data, (b << 16) | a);
+    out = finish_chunk(out, "IDAT", data - zlib);
+
+    out = finish_chunk(out, "IEND", 0);
+    return out - png;
+}
+
+static void write_png(Framebuffer *framebuffer, uint64_t frame) {
+    static uint8_t png[PNG_MAX_SIZE];
+    char path[4096];
+    size_t size = encode_png(framebuffer->composed, png);
+
+    snprintf(path, sizeof(path), "%s%06llu.png", framebuffer->output, (unsigned long long)frame);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL || fwrite(png, 1, size, file) != size) {
+        if (!framebuffer->failed)
+            fprintf(stderr, "Warning: Unable to write frame %s\n", path);
+        framebuffer->failed = 1;
+    } else {
+        framebuffer->bytes_written += size;
+    }
+    if (file)
+        fclose(file);
+}
+
+static void write_raw(Framebuffer *framebuffer, const FrameUpdate *update) {
+    uint8_t header[16];
+    put_le(header, update->frame, 8);
+    put_le(header + 8, update->dirty, 8);
+    fwrite(header, 1, sizeof(header), framebuffer->raw_file);
+    framebuffer->bytes_written += sizeof(header);
+    for (int tile = 0; tile < FB_TILE_COUNT; tile++) {
+        if (update->dirty & (1ull << tile)) {
+            fwrite(update->tiles[tile], 1, sizeof(update->tiles[tile]), framebuffer->raw_file);
+            framebuffer->bytes_written += sizeof(update->tiles[tile]);
+        }
+    }
+}
+
+static void compose(Framebuffer *framebuffer, const FrameUpdate *update) {
+    for (int tile = 0; tile < FB_TILE_COUNT; tile++) {
+        if (!(update->dirty & (1ull << tile)))
+            continue;
+        uint8_t *origin = framebuffer->composed + (tile / FB_TILES_X) * FB_TILE_SIZE * FB_WIDTH +
+                          (tile % FB_TILES_X) * FB_TILE_SIZE;
+        for (int row = 0; row < FB_TILE_SIZE; row++)
+            memcpy(origin + row * FB_WIDTH, update->tiles[tile] + row * FB_TILE_SIZE, FB_TILE_SIZE);
+        framebuffer->tiles_encoded++;
+    }
+}
+
+static void *encoder_main(void *argument) {
+    Framebuffer *framebuffer = argument;
+
+    pthread_mutex_lock(&framebuffer->lock);
+    for (;;) {
+        while (framebuffer->count == 0 && !framebuffer->closing)
+            pthread_cond_wait(&framebuffer->queued, &framebuffer->lock);
+        if (framebuffer->count == 0)
+            break;
+        // The slot stays owned by the encoder until count drops below
+        FrameUpdate *update = &framebuffer->queue[framebuffer->head];
+        pthread_mutex_unlock(&framebuffer->lock);
+
+        compose(framebuffer, update);
+        if (framebuffer->raw)
+            write_raw(framebuffer, update);
+        else
+            write_png(framebuffer, update->frame);
+        framebuffer->frames_encoded++;
+
+        pthread_mutex_lock(&framebuffer->lock);
+        framebuffer->head = (framebuffer->head + 1) % FB_QUEUE_DEPTH;
+        framebuffer->count--;
+        pthread_cond_signal(&framebuffer->drained);
+    }
+    pthread_mutex_unlock(&framebuffer->lock);
+    return NULL;
+}
+
+static void end_frame(Framebuffer *framebuffer) {
+    uint64_t dirty = framebuffer->dirty;
+    framebuffer->frame++;
+    if (dirty == 0)
+        return;
+
+    pthread_mutex_lock(&framebuffer->lock);
+    if (framebuffer->count == FB_QUEUE_DEPTH) {
+        framebuffer->stalls++;
+        while (framebuffer->count == FB_QUEUE_DEPTH)
+            pthread_cond_wait(&framebuffer->drained, &framebuffer->lock);
+    }
+    FrameUpdate *update = &framebuffer->queue[(framebuffer->head + framebuffer->count) % FB_QUEUE_DEPTH];
+    pthread_mutex_unlock(&framebuffer->lock);
+
+    // The free slot is ours until it is counted in below
+    update->frame = framebuffer->frame;
+    update->dirty = dirty;
+    for (int tile = 0; tile < FB_TILE_COUNT; tile++) {
+        if (!(dirty & (1ull << tile)))
+            continue;
+        const uint8_t *origin = framebuffer->pixels + (tile / FB_TILES_X) * FB_TILE_SIZE * FB_WIDTH +
+                                (tile % FB_TILES_X) * FB_TILE_SIZE;
+        for (int row = 0; row < FB_TILE_SIZE; row++)
+            memcpy(update->tiles[tile] + row * FB_TILE_SIZE, origin + row * FB_WIDTH, FB_TILE_SIZE);
+    }
+    framebuffer->dirty = 0;
+
+    pthread_mutex_lock(&framebuffer->lock);
+    framebuffer->count++;
+    pthread_cond_signal(&framebuffer->queued);
+    pthread_mutex_unlock(&framebuffer->lock);
+}
+
+static uint8_t framebuffer_read(void *context, uint16_t address) {
+    Framebuffer *framebuffer = context;
+
+    if (address >= FB_PIXELS_START)
+        return framebuffer->pixels[address - FB_PIXELS_START];
+    switch ((address - framebuffer->base) % FB_REGISTER_COUNT) {
+        case FB_FRAME_LO:
+            return framebuffer->frame & 0xFF;
+        case FB_FRAME_HI:
+            return (framebuffer->frame >> 8) & 0xFF;
+        default:
+            return 0;
+    }
+}
+
+static void framebuffer_write(void *context, uint16_t address, uint8_t value) {
+    Framebuffer *framebuffer = context;
+
+    if (address >= FB_PIXELS_START) {
+        int offset = address - FB_PIXELS_START;
+        framebuffer->pixels[offset] = value;
+        framebuffer->dirty |= 1ull << ((offset / FB_WIDTH / FB_TILE_SIZE) * FB_TILES_X +
+                                       (offset % FB_WIDTH) / FB_TILE_SIZE);
+    } else if ((address - framebuffer->base) % FB_REGISTER_COUNT == FB_VSYNC) {
+        end_frame(framebuffer);
+    }
+}
+
+int framebuffer_attach(Framebuffer *framebuffer, uint16_t base, const char *output) {
+    memset(framebuffer, 0, sizeof(*framebuffer));
+    framebuffer->base = base;
+    framebuffer->output = output;
+    init_crc_table();
+
+    size_t length = strlen(output);
+    framebuffer->raw = length > 4 && strcmp(output + length - 4, ".raw") == 0;
+    if (framebuffer->raw) {
+        uint8_t header[14];
+        memcpy(header, FB_RAW_MAGIC, 8);
+        put_le(header + 8, FB_WIDTH, 2);
+        put_le(header + 10, FB_HEIGHT, 2);
+        put_le(header + 12, FB_TILE_SIZE, 2);
+        framebuffer->raw_file = fopen(output, "wb");
+        if (framebuffer->raw_file == NULL) {
+            printf("Error: Unable to open framebuffer output %s\n", output);
+            return -1;
+        }
+        fwrite(header, 1, sizeof(header), framebuffer->raw_file);
+        framebuffer->bytes_written = sizeof(header);
+    }
+
+    IoDevice registers = { base, base + FB_REGISTER_COUNT - 1, framebuffer_read, framebuffer_write,
+                           framebuffer };
+    IoDevice pixels = { FB_PIXELS_START, FB_PIXELS_END, framebuffer_read, framebuffer_write,
+                        framebuffer };
+    if (register_io_device(&registers) < 0 || register_io_device(&pixels) < 0)
+        return -1;
+
+    pthread_mutex_init(&framebuffer->lock, NULL);
+    pthread_cond_init(&framebuffer->queued, NULL);
+    pthread_cond_init(&framebuffer->drained, NULL);
+    if (pthread_create(&framebuffer->encoder, NULL, encoder_main, framebuffer) != 0) {
+        printf("Error: Unable to start the framebuffer encoder\n");
+        return -1;
+    }
+    framebuffer->running = 1;
+    return 0;
+}
+
+// Drains the queue and stops the encoder
+void framebuffer_close(Framebuffer *framebuffer) {
+    if (!framebuffer->running)
+        return;
+    pthread_mutex_lock(&framebuffer->lock);
+    framebuffer->closing = 1;
+    pthread_cond_signal(&framebuffer->queued);
+    pthread_mutex_unlock(&framebuffer->lock);
+    pthread_join(framebuffer->encoder, NULL);
+    framebuffer->running = 0;
+    if (framebuffer->raw_file)
+        fclose(framebuffer->raw_file);
+    framebuffer->raw_file = NULL;
+}
+
+void framebuffer_print_stats(const Framebuffer *framebuffer) {
+    printf("Framebuffer: %llu frames, %llu encoded, %llu tiles, %llu bytes written, "
+           "%llu vsync stalls\n",
+           (unsigned long long)framebuffer->frame, (unsigned long long)framebuffer->frames_encoded,
+           (unsigned long long)framebuffer->tiles_encoded,
+           (unsigned long long)framebuffer->bytes_written, (unsigned long long)framebuffer->stalls);
+}
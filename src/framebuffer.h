@@ -0,0 +1,71 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "../include/common.h"
+#include <pthread.h>
+
+// Headless 64x64 framebuffer, one RGB332 byte per pixel, mapped at
+// FB_PIXELS_START. Every pixel write marks its 8x8 tile in a dirty bitmap.
+// Writing FB_VSYNC ends a frame: the dirty tiles are copied into a queue
+// slot and the bitmap is cleared, and a background thread composes the
+// frame and encodes it, so the CPU thread never waits on file output
+// unless the queue is full. Frames with no dirty tiles write nothing.
+//
+// Output is one PNG per frame (<prefix>NNNNNN.png) or, for a name ending
+// in .raw, a single stream of changed-tile records (see framebuffer.c).
+
+#define FB_DEFAULT_BASE    0x2400
+#define FB_VSYNC           0x00   // Write: end the frame
+#define FB_FRAME_LO        0x01   // Read: frames ended so far
+#define FB_FRAME_HI        0x02
+#define FB_REGISTER_COUNT  0x04
+
+#define FB_PIXELS_START    0x3000
+#define FB_WIDTH           64
+#define FB_HEIGHT          64
+#define FB_TILE_SIZE       8
+#define FB_TILES_X         (FB_WIDTH / FB_TILE_SIZE)
+#define FB_TILE_COUNT      (FB_TILES_X * (FB_HEIGHT / FB_TILE_SIZE))   // 64, one bitmap word
+#define FB_PIXELS_END      (FB_PIXELS_START + FB_WIDTH * FB_HEIGHT - 1)
+#define FB_QUEUE_DEPTH     4
+
+typedef struct {
+    uint64_t frame;
+    uint64_t dirty;
+    uint8_t tiles[FB_TILE_COUNT][FB_TILE_SIZE * FB_TILE_SIZE];   // Only dirty tiles are filled
+} FrameUpdate;
+
+typedef struct {
+    uint16_t base;
+    uint8_t pixels[FB_WIDTH * FB_HEIGHT];      // CPU side
+    uint64_t dirty;
+    uint64_t frame;
+
+    // Encoder side
+    const char *output;
+    int raw;
+    FILE *raw_file;
+    uint8_t composed[FB_WIDTH * FB_HEIGHT];
+    pthread_t encoder;
+    int running;
+
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t drained;
+    FrameUpdate queue[FB_QUEUE_DEPTH];
+    int head;
+    int count;
+    int closing;
+
+    uint64_t frames_encoded;
+    uint64_t tiles_encoded;
+    uint64_t bytes_written;
+    uint64_t stalls;           // VSYNCs that found the queue full
+    int failed;
+} Framebuffer;
+
+int framebuffer_attach(Framebuffer *framebuffer, uint16_t base, const char *output);
+void framebuffer_close(Framebuffer *framebuffer);
+void framebuffer_print_stats(const Framebuffer *framebuffer);
+
+#endif
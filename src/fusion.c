@@ -0,0 +1,272 @@
+#include "fusion.h"
+#include "memory.h"
+#include "busstats.h"
+
+// Superinstructions: execute_fused() retires a hot opcode pair (or a chain
+// of pairs, forming triples) in one call instead of one switch iteration
+// per instruction. The enabled pair set comes either from the defaults
+// below or from a histogram written by execute_profiled().
+
+typedef struct {
+    uint8_t first;
+    uint8_t second;
+    uint8_t first_length;   // Bytes in the first instruction, opcode included
+    int (*handler)(CPU *cpu);
+} FusedPair;
+
+static uint8_t pair_enabled[256][256];
+static uint8_t chain_from[256];
+static const FusedPair *specialized[256];
+
+static uint64_t pair_counts[256][256];
+static int last_opcode = -1;
+
+// Opcode peek without I/O side effects; code running from I/O space is never fused
+static inline int peek_opcode(uint16_t address) {
+    uint8_t *page = current_bus->read_pages[address >> 8];
+    if (page)
+        return page[address & 0xFF];
+    if (address >= IO_REGISTERS_START && address <= IO_REGISTERS_END)
+        return -1;
+    return read_memory(address);
+}
+
+// A fused instruction's opcode is peeked, not read through the bus
+static inline void count_peeked_fetch(uint16_t address) {
+    (void)address;
+    BUS_STATS_READ(address);
+    BUS_STATS_FETCH(address);
+}
+
+// fetch() with mapped pages read in place
+static inline uint8_t fused_fetch(CPU *cpu) {
+    uint16_t address = cpu->PC++;
+    uint8_t *page = current_bus->read_pages[address >> 8];
+    if (page) {
+        BUS_STATS_READ(address);
+        return page[address & 0xFF];
+    }
+    return read_memory(address);
+}
+
+// LDA #imm / STA abs
+static int fused_lda_imm_sta_abs(CPU *cpu) {
+    cpu->A = fused_fetch(cpu);
+    update_zero_and_negative_flags(cpu, cpu->A);
+    cpu->PC++;
+    uint16_t address = fused_fetch(cpu);
+    address |= (fused_fetch(cpu) << 8);
+    write_memory(address, cpu->A);
+    cpu->cycles += 6;
+    return 2;
+}
+
+// DEX / BNE
+static int fused_dex_bne(CPU *cpu) {
+    cpu->X--;
+    update_zero_and_negative_flags(cpu, cpu->X);
+    cpu->PC++;
+    int8_t offset = fused_fetch(cpu);
+    if (cpu->X != 0) cpu->PC += offset;
+    cpu->cycles += 4;
+    return 2;
+}
+
+// DEY / BNE
+static int fused_dey_bne(CPU *cpu) {
+    cpu->Y--;
+    update_zero_and_negative_flags(cpu, cpu->Y);
+    cpu->PC++;
+    int8_t offset = fused_fetch(cpu);
+    if (cpu->Y != 0) cpu->PC += offset;
+    cpu->cycles += 4;
+    return 2;
+}
+
+// CMP #imm / BEQ
+static int fused_cmp_imm_beq(CPU *cpu) {
+    uint8_t value = fused_fetch(cpu);
+    if (cpu->A >= value) SET_FLAG(cpu, FLAG_CARRY);
+    else CLEAR_FLAG(cpu, FLAG_CARRY);
+    update_zero_and_negative_flags(cpu, cpu->A - value);
+    cpu->PC++;
+    int8_t offset = fused_fetch(cpu);
+    if (cpu->A == value) cpu->PC += offset;
+    cpu->cycles += 4;
+    return 2;
+}
+
+// CMP #imm / BNE
+static int fused_cmp_imm_bne(CPU *cpu) {
+    uint8_t value = fused_fetch(cpu);
+    if (cpu->A >= value) SET_FLAG(cpu, FLAG_CARRY);
+    else CLEAR_FLAG(cpu, FLAG_CARRY);
+    update_zero_and_negative_flags(cpu, cpu->A - value);
+    cpu->PC++;
+    int8_t offset = fused_fetch(cpu);
+    if (cpu->A != value) cpu->PC += offset;
+    cpu->cycles += 4;
+    return 2;
+}
+
+// INC zp / BNE
+static int fused_inc_zp_bne(CPU *cpu) {
+    uint8_t address = fused_fetch(cpu);
+    uint8_t value = read_memory(address) + 1;
+    write_memory(address, value);
+    update_zero_and_negative_flags(cpu, value);
+    if (address == cpu->PC) { // INC rewrote the branch opcode
+        cpu->cycles += 5;
+        return 1;
+    }
+    cpu->PC++;
+    int8_t offset = fused_fetch(cpu);
+    if (value != 0) cpu->PC += offset;
+    cpu->cycles += 7;
+    return 2;
+}
+
+// Grouped by first opcode, terminated by a NULL handler
+static const FusedPair fused_pairs[] = {
+    { 0xA9, 0x8D, 2, fused_lda_imm_sta_abs },
+    { 0xCA, 0xD0, 1, fused_dex_bne },
+    { 0x88, 0xD0, 1, fused_dey_bne },
+    { 0xC9, 0xF0, 2, fused_cmp_imm_beq },
+    { 0xC9, 0xD0, 2, fused_cmp_imm_bne },
+    { 0xE6, 0xD0, 2, fused_inc_zp_bne },
+    { 0x00, 0x00, 0, NULL },
+};
+
+void fusion_enable_pair(uint8_t first, uint8_t second) {
+    pair_enabled[first][second] = 1;
+    chain_from[first] = 1;
+
+    for (const FusedPair *pair = fused_pairs; pair->handler; pair++) {
+        if (pair->first == first && specialized[first] == NULL)
+            specialized[first] = pair;
+    }
+}
+
+void fusion_enable_defaults(void) {
+    for (const FusedPair *pair = fused_pairs; pair->handler; pair++)
+        fusion_enable_pair(pair->first, pair->second);
+}
+
+void fusion_clear(void) {
+    for (int i = 0; i < 256; i++) {
+        for (int j = 0; j < 256; j++)
+            pair_enabled[i][j] = 0;
+        chain_from[i] = 0;
+        specialized[i] = NULL;
+    }
+}
+
+// Reads "<first> <second> [count]" hex lines, as written by fusion_write_profile()
+int fusion_load_pairs(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error: Unable to open fusion pair file %s\n", filename);
+        return -1;
+    }
+
+    char line[128];
+    int loaded = 0;
+    while (loaded < FUSION_MAX_PAIRS && fgets(line, sizeof(line), file)) {
+        unsigned int first, second;
+        if (line[0] == '#' || sscanf(line, "%x %x", &first, &second) != 2)
+            continue;
+        if (first > 0xFF || second > 0xFF)
+            continue;
+        fusion_enable_pair(first, second);
+        loaded++;
+    }
+    fclose(file);
+    return loaded;
+}
+
+// Returns the number of instructions retired
+int execute_fused(CPU *cpu, uint8_t *memory) {
+    BUS_STATS_FETCH(cpu->PC);
+    uint8_t opcode = fetch(cpu, memory);
+
+    if (!chain_from[opcode]) {
+        execute_opcode(cpu, memory, opcode);
+        return 1;
+    }
+
+    const FusedPair *pair = specialized[opcode];
+    if (pair) {
+        int next = peek_opcode(cpu->PC + pair->first_length - 1);
+        for (; pair->handler && pair->first == opcode; pair++) {
+            if (pair->second == next && pair_enabled[opcode][next]) {
+                count_peeked_fetch(cpu->PC + pair->first_length - 1);
+                return pair->handler(cpu);
+            }
+        }
+    }
+
+    // Generic chaining through enabled pairs
+    int retired = 1;
+    execute_opcode(cpu, memory, opcode);
+    while (retired < FUSION_MAX_CHAIN && cpu->is_running && chain_from[opcode]) {
+        int next = peek_opcode(cpu->PC);
+        if (next < 0 || !pair_enabled[opcode][next])
+            break;
+        count_peeked_fetch(cpu->PC);
+        cpu->PC++;
+        execute_opcode(cpu, memory, next);
+        opcode = next;
+        retired++;
+    }
+    return retired;
+}
+
+void execute_profiled(CPU *cpu, uint8_t *memory) {
+    int opcode = peek_opcode(cpu->PC);
+    if (opcode >= 0 && last_opcode >= 0)
+        pair_counts[last_opcode][opcode]++;
+    last_opcode = opcode;
+    execute(cpu, memory);
+}
+
+typedef struct {
+    uint16_t pair;
+    uint64_t count;
+} PairCount;
+
+static int compare_pair_counts(const void *a, const void *b) {
+    const PairCount *x = a, *y = b;
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return x->pair - y->pair;
+}
+
+// Hottest pairs first; the output can be fed straight back to fusion_load_pairs()
+int fusion_write_profile(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Error: Unable to open profile file %s\n", filename);
+        return -1;
+    }
+
+    static PairCount counts[256 * 256];
+    int used = 0;
+    for (int i = 0; i < 256; i++) {
+        for (int j = 0; j < 256; j++) {
+            if (pair_counts[i][j]) {
+                counts[used].pair = (i << 8) | j;
+                counts[used].count = pair_counts[i][j];
+                used++;
+            }
+        }
+    }
+    qsort(counts, used, sizeof(PairCount), compare_pair_counts);
+
+    fprintf(file, "# first second count\n");
+    for (int i = 0; i < used; i++) {
+        fprintf(file, "%02X %02X %llu\n", counts[i].pair >> 8, counts[i].pair & 0xFF,
+                (unsigned long long)counts[i].count);
+    }
+    fclose(file);
+    return used;
+}
@@ -0,0 +1,22 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include "cpu.h"
+
+// Longest run of instructions a single execute_fused() call may retire
+#define FUSION_MAX_CHAIN   3
+// Upper bound on pairs taken from a profile file
+#define FUSION_MAX_PAIRS   32
+
+// Fused dispatch
+void fusion_enable_pair(uint8_t first, uint8_t second);
+void fusion_enable_defaults(void);
+void fusion_clear(void);
+int fusion_load_pairs(const char *filename);
+int execute_fused(CPU *cpu, uint8_t *memory);
+
+// Opcode pair histogram
+void execute_profiled(CPU *cpu, uint8_t *memory);
+int fusion_write_profile(const char *filename);
+
+#endif
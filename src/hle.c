@@ -0,0 +1,227 @@
+#include "hle.h"
+#include "memory.h"
+#include <string.h>
+
+uint8_t hle_index[MEMORY_SIZE];
+
+static HleHook hooks[HLE_MAX_HOOKS];
+static int hook_count = 0;
+static int verify_mode = 0;
+static _Thread_local int verifying = 0;
+
+static uint16_t read_word(uint16_t address) {
+    return read_memory(address) | (read_memory(address + 1) << 8);
+}
+
+// mul8: A * X, product low byte in A, high byte in X
+static int hle_mul8(CPU *cpu, uint16_t params) {
+    (void)params;
+    uint16_t product = cpu->A * cpu->X;
+    cpu->A = product & 0xFF;
+    cpu->X = product >> 8;
+    update_zero_and_negative_flags(cpu, cpu->A);
+    CLEAR_FLAG(cpu, FLAG_CARRY);
+    return 8 * 20;
+}
+
+// div8: A / X, quotient in A, remainder in X; division by zero is left to the guest
+static int hle_div8(CPU *cpu, uint16_t params) {
+    (void)params;
+    if (cpu->X == 0)
+        return -1;
+    uint8_t quotient = cpu->A / cpu->X;
+    cpu->X = cpu->A % cpu->X;
+    cpu->A = quotient;
+    update_zero_and_negative_flags(cpu, cpu->A);
+    return 8 * 24;
+}
+
+// memcpy: source, destination and length words at params..params+5; registers preserved
+static int hle_memcpy(CPU *cpu, uint16_t params) {
+    (void)cpu;
+    uint16_t source = read_word(params);
+    uint16_t dest = read_word(params + 2);
+    uint16_t length = read_word(params + 4);
+    for (uint16_t i = 0; i < length; i++)
+        write_memory(dest + i, read_memory(source + i));
+    return 20 + 14 * length;
+}
+
+// crc16: CRC-16/CCITT (init $FFFF) of the buffer whose address and length
+// words are at params..params+3; result low byte in A, high byte in X
+static int hle_crc16(CPU *cpu, uint16_t params) {
+    uint16_t address = read_word(params);
+    uint16_t length = read_word(params + 2);
+    uint16_t crc = 0xFFFF;
+
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= read_memory(address + i) << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    cpu->A = crc & 0xFF;
+    cpu->X = crc >> 8;
+    return 30 + 90 * length;
+}
+
+static const struct {
+    const char *name;
+    HleRoutine routine;
+} builtin_routines[] = {
+    { "mul8",   hle_mul8 },
+    { "div8",   hle_div8 },
+    { "memcpy", hle_memcpy },
+    { "crc16",  hle_crc16 },
+    { NULL, NULL },
+};
+
+int hle_register(uint16_t address, const char *name, HleRoutine routine, uint16_t params) {
+    if (hook_count == HLE_MAX_HOOKS) {
+        printf("Error: Too many HLE hooks\n");
+        return -1;
+    }
+    HleHook *hook = &hooks[hook_count++];
+    memset(hook, 0, sizeof(*hook));
+    hook->name = name;
+    hook->routine = routine;
+    hook->address = address;
+    hook->params = params;
+    hle_index[address] = hook_count;
+    return 0;
+}
+
+// Reads "<address> <routine> [params]" hex lines
+int hle_load_hooks(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error: Unable to open HLE hook file %s\n", filename);
+        return -1;
+    }
+
+    char line[128], name[32];
+    unsigned int address, params;
+    int loaded = 0;
+    while (fgets(line, sizeof(line), file)) {
+        params = 0;
+        if (line[0] == '#' || sscanf(line, "%x %31s %x", &address, name, &params) < 2)
+            continue;
+
+        int found = 0;
+        for (int i = 0; builtin_routines[i].name; i++) {
+            if (strcmp(builtin_routines[i].name, name) == 0) {
+                if (hle_register(address, builtin_routines[i].name, builtin_routines[i].routine, params) < 0) {
+                    fclose(file);
+                    return -1;
+                }
+                found = 1;
+                loaded++;
+            }
+        }
+        if (!found)
+            printf("Warning: Unknown HLE routine %s\n", name);
+    }
+    fclose(file);
+    return loaded;
+}
+
+void hle_set_verify(int verify) {
+    verify_mode = verify;
+}
+
+// Pops the return address pushed by JSR, as RTS would
+static void hle_return(CPU *cpu) {
+    uint8_t low = read_memory(0x0100 + ++cpu->SP);
+    uint8_t high = read_memory(0x0100 + ++cpu->SP);
+    cpu->PC = ((high << 8) | low) + 1;
+}
+
+static int same_registers(const CPU *a, const CPU *b) {
+    return a->A == b->A && a->X == b->X && a->Y == b->Y && a->SP == b->SP &&
+           a->PC == b->PC && a->status == b->status && a->is_running == b->is_running;
+}
+
+static void report_mismatch(HleHook *hook, const CPU *native, const CPU *guest,
+                            const uint8_t *native_ram, const uint8_t *guest_ram) {
+    printf("HLE mismatch in %s at $%04X:", hook->name, hook->address);
+    if (native->A != guest->A) printf(" A %02X/%02X", native->A, guest->A);
+    if (native->X != guest->X) printf(" X %02X/%02X", native->X, guest->X);
+    if (native->Y != guest->Y) printf(" Y %02X/%02X", native->Y, guest->Y);
+    if (native->SP != guest->SP) printf(" SP %02X/%02X", native->SP, guest->SP);
+    if (native->PC != guest->PC) printf(" PC %04X/%04X", native->PC, guest->PC);
+    if (native->status != guest->status) printf(" P %02X/%02X", native->status, guest->status);
+    for (int address = 0; address <= RAM_END; address++) {
+        if (native_ram[address] != guest_ram[address]) {
+            printf(" first RAM difference at $%04X (%02X/%02X)", address,
+                   native_ram[address], guest_ram[address]);
+            break;
+        }
+    }
+    printf(" (native/guest)\n");
+}
+
+// Runs the native routine, then the guest routine from the same state,
+// and compares the two. The guest result is the one kept.
+static int hle_verify(CPU *cpu, HleHook *hook) {
+    static _Thread_local uint8_t saved_ram[RAM_END + 1], native_ram[RAM_END + 1];
+    static _Thread_local uint8_t guest_ram[RAM_END + 1];
+    CPU saved = *cpu;
+    bus_save_ram(current_bus, saved_ram);
+
+    int cycles = hook->routine(cpu, hook->params);
+    if (cycles < 0) {
+        *cpu = saved;
+        return 0;
+    }
+    hle_return(cpu);
+    CPU native = *cpu;
+    bus_save_ram(current_bus, native_ram);
+
+    *cpu = saved;
+    cpu->PC = hook->address;
+    bus_restore_ram(current_bus, saved_ram);
+    verifying = 1;
+    for (long step = 0; step < HLE_VERIFY_STEPS && cpu->is_running; step++) {
+        execute(cpu, current_bus->ram);
+        if (cpu->SP == (uint8_t)(saved.SP + 2) && cpu->PC == native.PC)
+            break;
+    }
+    verifying = 0;
+    bus_save_ram(current_bus, guest_ram);
+
+    // Stack bytes below the final SP are scratch for either path
+    for (int address = 0x0100; address <= 0x0100 + cpu->SP; address++)
+        native_ram[address] = guest_ram[address];
+
+    if (!same_registers(&native, cpu) || memcmp(native_ram, guest_ram, sizeof(native_ram)) != 0) {
+        atomic_fetch_add_explicit(&hook->mismatches, 1, memory_order_relaxed);
+        report_mismatch(hook, &native, cpu, native_ram, guest_ram);
+    }
+    return 1;
+}
+
+// Called by jsr_absolute() after the return address is pushed. Returns 1
+// when the routine was handled and PC/SP already point past the call.
+int hle_call(CPU *cpu, uint16_t address) {
+    HleHook *hook = &hooks[hle_index[address] - 1];
+    if (verifying)
+        return 0;
+
+    atomic_fetch_add_explicit(&hook->calls, 1, memory_order_relaxed);
+    if (verify_mode)
+        return hle_verify(cpu, hook);
+
+    int cycles = hook->routine(cpu, hook->params);
+    if (cycles < 0)
+        return 0;
+    hle_return(cpu);
+    cpu->cycles += cycles;
+    return 1;
+}
+
+void hle_print_stats(void) {
+    for (int i = 0; i < hook_count; i++) {
+        printf("HLE %-8s $%04X: %llu calls, %llu mismatches\n", hooks[i].name, hooks[i].address,
+               (unsigned long long)atomic_load_explicit(&hooks[i].calls, memory_order_relaxed),
+               (unsigned long long)atomic_load_explicit(&hooks[i].mismatches, memory_order_relaxed));
+    }
+}
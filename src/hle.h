@@ -0,0 +1,38 @@
+#ifndef HLE_H
+#define HLE_H
+
+#include "cpu.h"
+#include <stdatomic.h>
+
+// High-level emulation of known guest routines. jsr_absolute() checks the
+// call target against hle_index[]; a hooked routine runs natively, applies
+// its effects to the CPU and memory, and returns as if RTS had executed.
+//
+// A routine returns the cycles to charge, or a negative value to decline
+// the call (the guest code then runs as usual).
+
+#define HLE_MAX_HOOKS    255
+#define HLE_VERIFY_STEPS 10000000
+
+typedef int (*HleRoutine)(CPU *cpu, uint16_t params);
+
+typedef struct {
+    const char *name;
+    HleRoutine routine;
+    uint16_t address;
+    uint16_t params;        // Routine-specific, e.g. a zero page parameter block
+    // Bumped by every machine that runs the hook, on any scheduler thread
+    _Atomic uint64_t calls;
+    _Atomic uint64_t mismatches;
+} HleHook;
+
+// Index + 1 into the hook list for each address, 0 when not hooked
+extern uint8_t hle_index[MEMORY_SIZE];
+
+int hle_register(uint16_t address, const char *name, HleRoutine routine, uint16_t params);
+int hle_load_hooks(const char *filename);
+void hle_set_verify(int verify);
+int hle_call(CPU *cpu, uint16_t address);
+void hle_print_stats(void);
+
+#endif
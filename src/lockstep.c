@@ -0,0 +1,234 @@
+#include "lockstep.h"
+#include "memory.h"
+#include "fusion.h"
+#include "variants.h"
+#include "disasm.h"
+#include <string.h>
+
+typedef struct {
+    const char *engine;
+    ExecuteFunction execute;    // NULL for fused dispatch
+    CPU cpu;
+    Bus bus;                    // Backing memory
+    Bus view;                   // Same reads, every write through write_hook()
+    uint64_t write_hash;
+    uint64_t writes;
+    uint64_t instructions;
+    uint8_t ram[MEMORY_SIZE];
+    uint8_t rom[ROM_SIZE];
+} Side;
+
+typedef struct {
+    CPU cpu;
+    uint64_t write_hash;
+    uint64_t writes;
+    uint64_t instructions;
+    uint8_t ram[RAM_END + 1];
+} SideState;
+
+static Side candidate_side, reference_side;
+static SideState candidate_checkpoint, reference_checkpoint;
+static uint64_t checkpoint_step = 0;
+
+static uint8_t read_hook(void *context, uint16_t address) {
+    Side *side = context;
+    current_bus = &side->bus;
+    uint8_t value = read_memory(address);
+    current_bus = &side->view;
+    return value;
+}
+
+static void write_hook(void *context, uint16_t address, uint8_t value) {
+    Side *side = context;
+    side->write_hash = (side->write_hash ^ ((uint32_t)address << 8 | value)) * 1099511628211ull;
+    side->writes++;
+    current_bus = &side->bus;
+    write_memory(address, value);
+    current_bus = &side->view;
+}
+
+static int init_side(Side *side, const char *engine, uint16_t start) {
+    memset(side, 0, sizeof(*side));
+    side->engine = engine;
+    if (strcmp(engine, "reference") == 0) {
+        side->execute = execute;
+    } else if (strcmp(engine, "fused") != 0) {
+        const CpuVariant *variant = find_cpu_variant(engine);
+        if (variant == NULL) {
+            printf("Error: Unknown lockstep engine %s\n", engine);
+            return -1;
+        }
+        side->execute = variant->execute;
+    }
+
+    bus_init(&side->bus, side->ram, side->rom);
+    memcpy(side->ram, default_bus.ram, MEMORY_SIZE);
+    memcpy(side->rom, default_bus.rom, ROM_SIZE);
+    memcpy(side->view.read_pages, side->bus.read_pages, sizeof(side->view.read_pages));
+    side->view.miss_read = read_hook;
+    side->view.miss_write = write_hook;
+    side->view.miss_context = side;
+    side->write_hash = 14695981039346656037ull;
+
+    reset_cpu(&side->cpu);
+    side->cpu.PC = start;
+    return 0;
+}
+
+int lockstep_init(const char *candidate, const char *reference, uint16_t start) {
+    if (mapper_active()) {
+        printf("Error: Lockstep runs do not support mappers\n");
+        return -1;
+    }
+    if (init_side(&candidate_side, candidate, start) < 0 ||
+        init_side(&reference_side, reference, start) < 0)
+        return -1;
+    if (reference_side.execute == NULL) {
+        printf("Error: The lockstep reference must run one instruction per step\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Returns the instructions retired
+static int step_side(Side *side) {
+    int retired = 1;
+    current_bus = &side->view;
+    if (side->execute)
+        side->execute(&side->cpu, side->ram);
+    else
+        retired = execute_fused(&side->cpu, side->ram);
+    current_bus = &default_bus;
+    side->instructions += retired;
+    return retired;
+}
+
+static void step(void) {
+    int retired = step_side(&candidate_side);
+    for (int i = 0; i < retired && reference_side.cpu.is_running; i++)
+        step_side(&reference_side);
+}
+
+static int running(void) {
+    return candidate_side.cpu.is_running && reference_side.cpu.is_running;
+}
+
+static int same_state(void) {
+    const Side *a = &candidate_side, *b = &reference_side;
+    return a->cpu.A == b->cpu.A && a->cpu.X == b->cpu.X && a->cpu.Y == b->cpu.Y &&
+           a->cpu.SP == b->cpu.SP && a->cpu.status == b->cpu.status && a->cpu.PC == b->cpu.PC &&
+           a->cpu.is_running == b->cpu.is_running && a->cpu.cycles == b->cpu.cycles &&
+           a->write_hash == b->write_hash && a->writes == b->writes;
+}
+
+static void save_side(const Side *side, SideState *state) {
+    state->cpu = side->cpu;
+    state->write_hash = side->write_hash;
+    state->writes = side->writes;
+    state->instructions = side->instructions;
+    bus_save_ram(&side->bus, state->ram);
+}
+
+static void restore_side(Side *side, const SideState *state) {
+    side->cpu = state->cpu;
+    side->write_hash = state->write_hash;
+    side->writes = state->writes;
+    side->instructions = state->instructions;
+    bus_restore_ram(&side->bus, state->ram);
+}
+
+static void checkpoint(uint64_t steps) {
+    save_side(&candidate_side, &candidate_checkpoint);
+    save_side(&reference_side, &reference_checkpoint);
+    checkpoint_step = steps;
+}
+
+// Back to the last checkpoint, then <count> steps
+static void replay(uint64_t count) {
+    restore_side(&candidate_side, &candidate_checkpoint);
+    restore_side(&reference_side, &reference_checkpoint);
+    for (uint64_t i = 0; i < count && running(); i++)
+        step();
+}
+
+static void dump_side(const Side *side) {
+    const CPU *cpu = &side->cpu;
+    printf("  %-10s A=%02X X=%02X Y=%02X P=%02X SP=%02X PC=%04X %s, %llu cycles, "
+           "%llu instructions, %llu writes (hash %016llx)\n",
+           side->engine, cpu->A, cpu->X, cpu->Y, cpu->status, cpu->SP, cpu->PC,
+           cpu->is_running ? "running" : "halted", (unsigned long long)cpu->cycles,
+           (unsigned long long)side->instructions, (unsigned long long)side->writes,
+           (unsigned long long)side->write_hash);
+}
+
+// Replays up to the step before <steps> and dumps both sides around it
+static void report_divergence(uint64_t steps) {
+    replay(steps - checkpoint_step - 1);
+    uint16_t pc = candidate_side.cpu.PC;
+    uint8_t bytes[3];
+    char text[DISASM_MAX_LINE];
+    for (int i = 0; i < 3; i++) {
+        uint16_t address = pc + i;
+        bytes[i] = candidate_side.bus.read_pages[address >> 8]
+                       ? candidate_side.bus.read_pages[address >> 8][address & 0xFF] : 0;
+    }
+    disasm_instruction(bytes, pc, text, sizeof(text));
+
+    printf("Lockstep divergence at step %llu, $%04X: %02X %s\n", (unsigned long long)steps, pc,
+           bytes[0], text);
+    printf(" Before:\n");
+    dump_side(&candidate_side);
+    dump_side(&reference_side);
+    step();
+    printf(" After:\n");
+    dump_side(&candidate_side);
+    dump_side(&reference_side);
+
+    int shown = 0;
+    for (int address = 0; address <= RAM_END && shown < 8; address++) {
+        uint8_t a = candidate_side.ram[address], b = reference_side.ram[address];
+        if (a != b) {
+            printf(" RAM $%04X: %02X/%02X (%s/%s)\n", address, a, b, candidate_side.engine,
+                   reference_side.engine);
+            shown++;
+        }
+    }
+}
+
+// Returns 0 when the engines agreed throughout, 1 on a divergence
+int lockstep_run(uint64_t interval, uint64_t max_steps) {
+    uint64_t steps = 0;
+    if (interval == 0)
+        interval = 1;
+
+    checkpoint(0);
+    while (running() && (max_steps == 0 || steps < max_steps)) {
+        step();
+        steps++;
+        if (steps % interval != 0 && running() && steps != max_steps)
+            continue;
+        if (same_state()) {
+            checkpoint(steps);
+            continue;
+        }
+
+        // First step after the checkpoint whose state differs
+        uint64_t good = 0, bad = steps - checkpoint_step;
+        while (bad - good > 1) {
+            uint64_t middle = good + (bad - good) / 2;
+            replay(middle);
+            if (same_state())
+                good = middle;
+            else
+                bad = middle;
+        }
+        report_divergence(checkpoint_step + bad);
+        return 1;
+    }
+
+    printf("Lockstep: %s matched %s for %llu steps (%llu instructions, %llu writes)\n",
+           candidate_side.engine, reference_side.engine, (unsigned long long)steps,
+           (unsigned long long)reference_side.instructions,
+           (unsigned long long)reference_side.writes);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "cpu.h"
+
+// Differential testing of two execution engines. Both start from the
+// default bus contents and PC. The candidate takes one step (an
+// instruction, or a block for fused dispatch), then the reference runs
+// as many instructions. Registers, cycles and a rolling hash of every
+// write are compared every <interval> steps. On a difference, the run
+// bisects from the last matching checkpoint to the first differing step
+// and dumps both states.
+//
+// Engines: "reference" (execute()), "fused" (execute_fused()) or the name
+// of a CPU variant. The reference engine must retire one instruction per
+// step.
+
+int lockstep_init(const char *candidate, const char *reference, uint16_t start);
+int lockstep_run(uint64_t interval, uint64_t max_steps);
+
+#endif
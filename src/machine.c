@@ -0,0 +1,35 @@
+#include "machine.h"
+#include <stdlib.h>
+
+// New machine with the RAM and ROM contents of <image>, reset to <start>.
+// RAM pages are copied on demand and ROM pages shared (see bus_init_sparse).
+// I/O devices and mapper state are per bus and are not copied.
+Machine *machine_create(int id, const Bus *image, uint16_t start, ExecuteFunction step) {
+    Machine *machine = calloc(1, sizeof(Machine));
+    if (machine == NULL) {
+        printf("Error: Out of memory creating machine %d\n", id);
+        return NULL;
+    }
+
+    machine->id = id;
+    machine->step = step ? step : execute;
+    if (bus_init_sparse(&machine->bus, image) < 0) {
+        free(machine);
+        return NULL;
+    }
+    reset_cpu(&machine->cpu);
+    machine->cpu.PC = start;
+    machine->state = MACHINE_PARKED;
+    char label[16];
+    snprintf(label, sizeof(label), "%d", id);
+    metrics_register(&machine->metrics, label);
+    return machine;
+}
+
+void machine_destroy(Machine *machine) {
+    if (machine == NULL)
+        return;
+    metrics_unregister(&machine->metrics);
+    bus_release(&machine->bus);
+    free(machine);
+}
@@ -0,0 +1,44 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "cpu.h"
+#include "memory.h"
+#include "variants.h"
+#include "metrics.h"
+
+// One emulated machine: CPU, its own sparse address space and the state
+// the scheduler keeps for it.
+
+typedef enum {
+    MACHINE_READY,      // On the run queue
+    MACHINE_RUNNING,    // Owned by a worker thread
+    MACHINE_PARKED,     // Waiting for scheduler_wake()
+    MACHINE_HALTED,
+} MachineState;
+
+typedef struct Machine {
+    int id;
+    CPU cpu;
+    Bus bus;
+    ExecuteFunction step;       // One instruction
+
+    // Scheduler state, guarded by the scheduler lock
+    MachineState state;
+    int wake_pending;           // Woken while running; requeue instead of parking
+    int park_requested;         // Set through scheduler_park_current()
+    struct Machine *next;       // Run queue link
+    uint64_t ready_since_ns;
+
+    // Statistics
+    uint64_t quanta;
+    uint64_t parks;
+    uint64_t wakes;
+    uint64_t wait_ns_total;     // Time spent runnable but not running
+    uint64_t wait_ns_max;
+    MetricsCounters metrics;
+} Machine;
+
+Machine *machine_create(int id, const Bus *image, uint16_t start, ExecuteFunction step);
+void machine_destroy(Machine *machine);
+
+#endif
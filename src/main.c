@@ -1,33 +1,455 @@
 #include "cpu.h"
 #include "memory.h"
+#include "fusion.h"
+#include "variants.h"
+#include "mapper.h"
+#include "dma.h"
+#include "hle.h"
+#include "scheduler.h"
+#include "network.h"
+#include "system.h"
+#include "lockstep.h"
+#include "busstats.h"
+#include "metrics.h"
+#include "console.h"
+#include "cache.h"
+#include "framebuffer.h"
+#include "serial.h"
+#include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define MEMORY_SIZE 65536
 
+static void print_usage(void) {
+    printf("Usage: <program> [options] <bin_file>\n");
+    printf("  --fuse                 Fuse the default hot opcode pairs\n");
+    printf("  --fuse-pairs <file>    Fuse the opcode pairs listed in <file>\n");
+    printf("  --profile-pairs <file> Write the opcode pair histogram to <file>\n");
+    printf("  --variant <name>       Run a specialized CPU variant\n");
+    printf("  --list-variants        List the CPU variants built in\n");
+    printf("  --rom <file>           Load a ROM image at $8000\n");
+    printf("  --mapper <type>        Bank-switch the ROM image with <type>\n");
+    printf("  --list-mappers         List the mapper types\n");
+    printf("  --dma                  Attach the DMA controller at $2100\n");
+    printf("  --dma-cycles           Charge DMA transfers to the CPU cycle count\n");
+    printf("  --hle <file>           Run the guest routines listed in <file> natively\n");
+    printf("  --hle-verify           Also run the guest routines and report differences\n");
+    printf("  --machines <n>         Run <n> copies of the program on the scheduler\n");
+    printf("  --threads <n>          Scheduler worker threads (default 1)\n");
+    printf("  --quantum <cycles>     Cycles per scheduler turn (default %d)\n", SCHEDULER_DEFAULT_QUANTUM);
+    printf("  --machine-stats <file> Write per-machine scheduler statistics to <file>\n");
+    printf("  --network <file>       Join the --machines nodes with the links in <file>\n");
+    printf("  --link-latency <cycles> Link delay and synchronization window (default %d)\n",
+           NETWORK_DEFAULT_LATENCY);
+    printf("  --max-cycles <cycles>  Stop a network or multi-CPU run after <cycles>,\n");
+    printf("                         or a lockstep run after <cycles> steps\n");
+    printf("  --cpus <n>             Run <n> CPUs on the shared bus (CPU n starts with X = n)\n");
+    printf("  --system <file>        Page ownership and start addresses for --cpus\n");
+    printf("  --interleave <cycles>  Multi-CPU interleaving slice (default %d)\n",
+           SYSTEM_DEFAULT_GRANULARITY);
+    printf("  --strict               Interleave the CPUs on one thread instead of in parallel\n");
+    printf("  --bus-stats <file>     Write the bus heatmap at exit and on SIGUSR1 (CSV or .json)\n");
+    printf("  --metrics <target>     Export Prometheus metrics to a file or unix:<socket>\n");
+    printf("  --metrics-interval <s> Seconds between metrics file updates (default 5)\n");
+    printf("  --lockstep <engine>    Check an engine (fused or a variant) against the reference\n");
+    printf("  --lockstep-against <engine> Engine to check against (default reference)\n");
+    printf("  --lockstep-interval <n> Compare every <n> steps, bisecting on a difference\n");
+    printf("  --console              Attach the console at $%04X\n", CONSOLE_DEFAULT_BASE);
+    printf("  --input <file>         Attach the console and feed it <file> as input\n");
+    printf("  --cache <dir>          Reuse or record the result of this run in <dir>\n");
+    printf("  --framebuffer <prefix> Attach the framebuffer, writing <prefix>NNNNNN.png per frame\n");
+    printf("                         or one changed-tile stream if <prefix> ends in .raw\n");
+    printf("  --serial <target>      Attach a serial port at $%04X bridged to pty or unix:<path>;\n",
+           SERIAL_DEFAULT_BASE);
+    printf("                         with --machines, one per machine (socket paths get .<id>)\n");
+}
+
+// Everything a single-machine run depends on, taken just before it starts
+static CacheKey run_key(const CPU *cpu, const char *engine, int dma, int dma_cycles,
+                        const Console *console, uint16_t load_address) {
+    CacheHash hash;
+    uint8_t registers[] = { cpu->A, cpu->X, cpu->Y, cpu->SP, cpu->status, cpu->is_running,
+                            cpu->PC & 0xFF, cpu->PC >> 8, load_address & 0xFF, load_address >> 8,
+                            dma, dma_cycles, console != NULL };
+    uint64_t input_size = console ? console->input_size : 0;
+    CacheKey image = cache_memory_digest();
+    CacheKey build = cache_build_digest();
+
+    cache_hash_init(&hash);
+    cache_hash_update(&hash, &build, sizeof(build));
+    cache_hash_update(&hash, engine, strlen(engine) + 1);
+    cache_hash_update(&hash, registers, sizeof(registers));
+    cache_hash_update(&hash, &cpu->cycles, sizeof(cpu->cycles));
+    cache_hash_update(&hash, &image, sizeof(image));
+    cache_hash_update(&hash, &input_size, sizeof(input_size));
+    if (input_size > 0)
+        cache_hash_update(&hash, console->input, input_size);
+    return cache_hash_final(&hash);
+}
+
+// Single-machine loop that publishes to the metrics exporter. Picks the
+// engine in the same order as main's dispatch: a variant over fusion.
+static void run_with_metrics(CPU *cpu, const CpuVariant *variant, int fused) {
+    static MetricsCounters counters;
+    uint64_t instructions = 0;
+
+    metrics_register(&counters, "main");
+    current_metrics = &counters;
+    while (cpu->is_running) {
+        if (variant) {
+            variant->execute(cpu, memory);
+            instructions++;
+        } else if (fused) {
+            instructions += execute_fused(cpu, memory);
+        } else {
+            execute(cpu, memory);
+            instructions++;
+        }
+        if (instructions >= METRICS_FLUSH_INTERVAL) {
+            metrics_publish(&counters, instructions, cpu->cycles);
+            instructions = 0;
+        }
+    }
+    metrics_publish(&counters, instructions, cpu->cycles);
+}
+
 int main(int argc, char**argv) {
-    if (argc < 2) {
-        printf("Usage: <program> <bin_file>\n");
+    const char *program = NULL;
+    const char *fuse_pairs = NULL;
+    const char *profile_pairs = NULL;
+    const CpuVariant *variant = NULL;
+    const char *rom_file = NULL;
+    const char *mapper_type = NULL;
+    int dma = 0;
+    int bus_stats = 0;
+    int dma_cycles = 0;
+    const char *hle_hooks = NULL;
+    int fuse = 0;
+    int machine_count = 0;
+    int threads = 1;
+    uint64_t quantum = SCHEDULER_DEFAULT_QUANTUM;
+    const char *machine_stats = NULL;
+    const char *network = NULL;
+    uint64_t link_latency = NETWORK_DEFAULT_LATENCY;
+    uint64_t max_cycles = 0;
+    int cpu_count = 0;
+    const char *system_config = NULL;
+    uint64_t interleave = SYSTEM_DEFAULT_GRANULARITY;
+    int strict = 0;
+    const char *lockstep = NULL;
+    const char *lockstep_against = "reference";
+    uint64_t lockstep_interval = 1;
+    const char *metrics = NULL;
+    int metrics_interval = 5;
+    int console = 0;
+    const char *input = NULL;
+    const char *cache_dir = NULL;
+    const char *framebuffer = NULL;
+    const char *serial = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fuse") == 0) {
+            fuse = 1;
+        } else if (strcmp(argv[i], "--fuse-pairs") == 0 && i + 1 < argc) {
+            fuse_pairs = argv[++i];
+        } else if (strcmp(argv[i], "--profile-pairs") == 0 && i + 1 < argc) {
+            profile_pairs = argv[++i];
+        } else if (strcmp(argv[i], "--variant") == 0 && i + 1 < argc) {
+            variant = find_cpu_variant(argv[++i]);
+            if (variant == NULL) {
+                printf("Error: Unknown CPU variant %s\n", argv[i]);
+                list_cpu_variants();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--list-variants") == 0) {
+            list_cpu_variants();
+            return 0;
+        } else if (strcmp(argv[i], "--rom") == 0 && i + 1 < argc) {
+            rom_file = argv[++i];
+        } else if (strcmp(argv[i], "--mapper") == 0 && i + 1 < argc) {
+            mapper_type = argv[++i];
+        } else if (strcmp(argv[i], "--list-mappers") == 0) {
+            list_mappers();
+            return 0;
+        } else if (strcmp(argv[i], "--dma") == 0) {
+            dma = 1;
+        } else if (strcmp(argv[i], "--dma-cycles") == 0) {
+            dma = 1;
+            dma_cycles = 1;
+        } else if (strcmp(argv[i], "--hle") == 0 && i + 1 < argc) {
+            hle_hooks = argv[++i];
+        } else if (strcmp(argv[i], "--hle-verify") == 0) {
+            hle_set_verify(1);
+        } else if (strcmp(argv[i], "--machines") == 0 && i + 1 < argc) {
+            machine_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc) {
+            quantum = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--machine-stats") == 0 && i + 1 < argc) {
+            machine_stats = argv[++i];
+        } else if (strcmp(argv[i], "--network") == 0 && i + 1 < argc) {
+            network = argv[++i];
+        } else if (strcmp(argv[i], "--link-latency") == 0 && i + 1 < argc) {
+            link_latency = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc) {
+            max_cycles = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--cpus") == 0 && i + 1 < argc) {
+            cpu_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--system") == 0 && i + 1 < argc) {
+            system_config = argv[++i];
+        } else if (strcmp(argv[i], "--interleave") == 0 && i + 1 < argc) {
+            interleave = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--strict") == 0) {
+            strict = 1;
+        } else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc) {
+            lockstep = argv[++i];
+        } else if (strcmp(argv[i], "--lockstep-against") == 0 && i + 1 < argc) {
+            lockstep_against = argv[++i];
+        } else if (strcmp(argv[i], "--lockstep-interval") == 0 && i + 1 < argc) {
+            lockstep_interval = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--bus-stats") == 0 && i + 1 < argc) {
+            if (bus_stats_enable(argv[++i]) < 0)
+                return 1;
+            bus_stats = 1;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics = argv[++i];
+        } else if (strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+            metrics_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--console") == 0) {
+            console = 1;
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            console = 1;
+            input = argv[++i];
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--framebuffer") == 0 && i + 1 < argc) {
+            framebuffer = argv[++i];
+        } else if (strcmp(argv[i], "--serial") == 0 && i + 1 < argc) {
+            serial = argv[++i];
+        } else if (argv[i][0] == '-') {
+            print_usage();
+            return 1;
+        } else {
+            program = argv[i];
+        }
+    }
+
+    if (program == NULL && rom_file == NULL) {
+        print_usage();
+        return 1;
+    }
+
+    // Devices register on default_bus and fusion only drives the main loop;
+    // machine_create() copies neither, so these would be silently dropped
+    if (machine_count > 0 && !network &&
+        (fuse || fuse_pairs || dma || console || input || framebuffer)) {
+        printf("Error: --fuse, --fuse-pairs, --dma, --console, --input and --framebuffer\n"
+               "       do not apply to --machines runs\n");
+        return 1;
+    }
+    // Lockstep runs both engines on device-less buses of their own
+    if (lockstep && (dma || console || input || framebuffer)) {
+        printf("Error: --dma, --console, --input and --framebuffer\n"
+               "       do not apply to --lockstep runs\n");
+        return 1;
+    }
+    // Machines and network nodes copy the image but not the mapper's bank
+    // state, so bank-select writes would land on ROM
+    if ((machine_count > 0 || network) && mapper_type) {
+        printf("Error: --mapper does not apply to --machines or --network runs\n");
         return 1;
     }
 
     CPU cpu;
     initialize_memory();
     reset_cpu(&cpu);
-    
+
+    if (rom_file && mapper_type) {
+        if (mapper_load(rom_file, mapper_type) < 0)
+            return 1;
+    } else if (rom_file) {
+        load_rom(rom_file);
+    }
+
+    static DmaController dma_controller;
+    if (dma && dma_attach(&dma_controller, &cpu, DMA_DEFAULT_BASE, dma_cycles) < 0)
+        return 1;
+
+    static Console console_device;
+    if (console && (console_attach(&console_device, CONSOLE_DEFAULT_BASE) < 0 ||
+                    (input && console_load_input(&console_device, input) < 0)))
+        return 1;
+
+    static Framebuffer framebuffer_device;
+    if (framebuffer && framebuffer_attach(&framebuffer_device, FB_DEFAULT_BASE, framebuffer) < 0)
+        return 1;
+
+    // With --machines every machine gets its own port when it is created
+    if (serial && (lockstep || cpu_count > 0 || network)) {
+        printf("Error: --serial applies to single-machine and --machines runs\n");
+        return 1;
+    }
+    if (serial && machine_count == 0 &&
+        (serial_attach(SERIAL_DEFAULT_BASE, serial, NULL) == NULL || serial_start() < 0))
+        return 1;
+
+    if (hle_hooks && hle_load_hooks(hle_hooks) < 0)
+        return 1;
+
     const uint16_t load_address = 0x0600;
-    load_program(argv[1], load_address);
+    if (program) {
+        load_program(program, load_address);
+    } else {
+        cpu.PC = read_memory(0xFFFC) | (read_memory(0xFFFD) << 8);
+    }
 
-    while (cpu.is_running) {
-        execute(&cpu, memory);
+    if (fuse)
+        fusion_enable_defaults();
+    if (fuse_pairs && fusion_load_pairs(fuse_pairs) < 0)
+        return 1;
+
+    if (metrics && metrics_start(metrics, metrics_interval) < 0)
+        return 1;
+
+    CacheKey cache_key, digest;
+    int cached = 0;
+    int status = 0;
+    if (cache_dir) {
+        if (lockstep || cpu_count > 0 || network || machine_count > 0 || metrics ||
+            profile_pairs || hle_hooks || mapper_type || framebuffer || serial || bus_stats) {
+            printf("Error: --cache only applies to single-machine runs without --hle, --mapper,\n"
+                   "       --metrics, --profile-pairs, --framebuffer, --serial or --bus-stats\n");
+            return 1;
+        }
+        const char *engine = variant ? variant->name : fuse || fuse_pairs ? "fused" : "reference";
+        cache_key = run_key(&cpu, engine, dma, dma_cycles, console ? &console_device : NULL,
+                            load_address);
+        cached = cache_lookup(cache_dir, cache_key, &cpu, &digest);
+        if (!cached && cache_capture_begin() < 0)
+            return 1;
+    }
+
+    if (cached) {
+        // Final state restored from the result cache
+    } else if (lockstep) {
+        if (strcmp(lockstep, "fused") == 0 && !fuse && !fuse_pairs)
+            fusion_enable_defaults();
+        if (lockstep_init(lockstep, lockstep_against, cpu.PC) < 0)
+            return 1;
+        status = lockstep_run(lockstep_interval, max_cycles);
+    } else if (cpu_count > 0) {
+        if (system_init(cpu_count, cpu.PC, variant ? variant->execute : NULL) < 0 ||
+            (system_config && system_load_config(system_config) < 0))
+            return 1;
+        system_run(!strict, interleave, max_cycles);
+        system_print_stats();
+        cpu = *system_cpu(0);
+        system_free();
+    } else if (network) {
+        if (network_load(network, machine_count ? machine_count : 2, &default_bus, cpu.PC,
+                         variant ? variant->execute : NULL) < 0 ||
+            network_run(threads, link_latency, max_cycles) < 0)
+            return 1;
+        network_print_stats();
+        cpu = network_node(0)->cpu;
+        network_free();
+    } else if (machine_count > 0) {
+        // The loaded image is the template for every machine; the first
+        // machine's final state is reported below
+        Machine **machines = calloc(machine_count, sizeof(Machine *));
+        if (machines == NULL || scheduler_start(threads, quantum) < 0)
+            return 1;
+        for (int i = 0; i < machine_count; i++) {
+            machines[i] = machine_create(i, &default_bus, cpu.PC,
+                                         variant ? variant->execute : NULL);
+            if (machines[i] == NULL)
+                return 1;
+            if (serial) {
+                char target[4096];
+                if (strncmp(serial, "unix:", 5) == 0 && machine_count > 1)
+                    snprintf(target, sizeof(target), "%s.%d", serial, i);
+                else
+                    snprintf(target, sizeof(target), "%s", serial);
+                current_bus = &machines[i]->bus;
+                SerialPort *port = serial_attach(SERIAL_DEFAULT_BASE, target, machines[i]);
+                current_bus = &default_bus;
+                if (port == NULL)
+                    return 1;
+            }
+            if (scheduler_add(machines[i]) < 0)
+                return 1;
+        }
+        // Guests waiting on a serial port run until they halt
+        if (serial) {
+            if (serial_start() < 0)
+                return 1;
+            scheduler_wait_halted();
+        } else {
+            scheduler_wait();
+        }
+        scheduler_print_stats();
+        bus_print_stats();
+        scheduler_shutdown();
+        if (machine_stats)
+            scheduler_write_stats(machine_stats);
+        cpu = machines[0]->cpu;
+        for (int i = 0; i < machine_count; i++)
+            machine_destroy(machines[i]);
+        free(machines);
+    } else if (metrics) {
+        run_with_metrics(&cpu, variant, fuse || fuse_pairs);
+    } else if (profile_pairs) {
+        while (cpu.is_running) {
+            execute_profiled(&cpu, memory);
+        }
+        fusion_write_profile(profile_pairs);
+    } else if (variant) {
+        variant->run(&cpu, memory);
+    } else if (fuse || fuse_pairs) {
+        while (cpu.is_running) {
+            execute_fused(&cpu, memory);
+        }
+    } else {
+        while (cpu.is_running) {
+            execute(&cpu, memory);
+        }
     }
 
-    printf("Final CPU State:\n");
-    printf("Accumulator: %02X\n", cpu.A);
-    printf("X Register: %02X\n", cpu.X);
-    printf("Y Register: %02X\n", cpu.Y);
-    printf("Status: %02X\n", cpu.status);
-    printf("Program Counter: %04X\n", cpu.PC);
-    printf("Stack Pointer: %02X\n", cpu.SP);
+    if (cache_dir) {
+        if (!cached) {
+            digest = cache_memory_digest();
+            cache_store(cache_dir, cache_key, &cpu, digest);
+        }
+        fprintf(stderr, "Result cache %s ", cached ? "hit" : "miss");
+        cache_print_key(stderr, cache_key);
+        fprintf(stderr, ", memory digest ");
+        cache_print_key(stderr, digest);
+        fprintf(stderr, "\n");
+    }
+
+    // A lockstep run reports its own result; cpu never ran
+    if (!lockstep) {
+        printf("Final CPU State:\n");
+        printf("Accumulator: %02X\n", cpu.A);
+        printf("X Register: %02X\n", cpu.X);
+        printf("Y Register: %02X\n", cpu.Y);
+        printf("Status: %02X\n", cpu.status);
+        printf("Program Counter: %04X\n", cpu.PC);
+        printf("Stack Pointer: %02X\n", cpu.SP);
+        printf("Cycles: %llu\n", (unsigned long long)cpu.cycles);
+    }
+    if (hle_hooks)
+        hle_print_stats();
+    if (framebuffer) {
+        framebuffer_close(&framebuffer_device);
+        framebuffer_print_stats(&framebuffer_device);
+    }
+    if (serial) {
+        serial_shutdown();
+        serial_print_stats();
+    }
 
-    return 0;
+    return status;
 }
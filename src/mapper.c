@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+#include "mapper.h"
+#include "memory.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const MapperType mapper_types[] = {
+    { "32k", "32 KB banks at $8000, any ROM write selects",                     0x8000, 0 },
+    { "16k", "16 KB banks at $8000, last bank fixed at $C000 (UxROM style)",    0x4000, 1 },
+    { "8k",  "8 KB banks at $8000/$A000/$C000/$E000, write to a window selects", 0x2000, 0 },
+    { NULL, NULL, 0, 0 },
+};
+
+#define mapper (current_bus->mapper)
+
+int mapper_active(void) {
+    return mapper.image != NULL;
+}
+
+static int window_count(void) {
+    return ROM_SIZE / mapper.type->bank_size;
+}
+
+void mapper_select(int window, uint32_t bank) {
+    uint32_t size = mapper.type->bank_size;
+    uint16_t start = ROM_START + window * size;
+
+    bank %= mapper.bank_count;
+    mapper.banks[window] = bank;
+    map_pages(current_bus->read_pages, start, size, mapper.image + (size_t)bank * size);
+}
+
+void mapper_write(uint16_t address, uint8_t value) {
+    // With a fixed last bank there is a single select register for window 0
+    int window = mapper.type->fixed_last ? 0 : (address - ROM_START) / mapper.type->bank_size;
+    mapper_select(window, value);
+}
+
+static const MapperType *find_mapper_type(const char *name) {
+    for (const MapperType *type = mapper_types; type->name; type++) {
+        if (strcmp(type->name, name) == 0)
+            return type;
+    }
+    return NULL;
+}
+
+// Maps the image read-only when possible so multi-megabyte files are
+// paged in on demand instead of copied
+static uint8_t *map_image(const char *filename, size_t *size, int *mmapped) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    *size = st.st_size;
+
+    uint8_t *image = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image != MAP_FAILED) {
+        *mmapped = 1;
+        close(fd);
+        return image;
+    }
+
+    image = malloc(*size);
+    if (image && read(fd, image, *size) != (ssize_t)*size) {
+        free(image);
+        image = NULL;
+    }
+    *mmapped = 0;
+    close(fd);
+    return image;
+}
+
+int mapper_load(const char *filename, const char *type_name) {
+    const MapperType *type = find_mapper_type(type_name);
+    if (type == NULL) {
+        printf("Error: Unknown mapper %s\n", type_name);
+        return -1;
+    }
+    if (current_bus->sparse) {
+        printf("Error: Mappers need a bus with its own ROM array\n");
+        return -1;
+    }
+
+    mapper_unload();
+    mapper.image = map_image(filename, &mapper.size, &mapper.mmapped);
+    if (mapper.image == NULL) {
+        printf("Error: Unable to open ROM file %s\n", filename);
+        return -1;
+    }
+    if (mapper.size % type->bank_size != 0) {
+        printf("Error: ROM size %zu is not a multiple of the %u byte bank size\n",
+               mapper.size, type->bank_size);
+        mapper_unload();
+        return -1;
+    }
+
+    mapper.type = type;
+    mapper.bank_count = mapper.size / type->bank_size;
+    for (int window = 0; window < window_count(); window++)
+        mapper_select(window, window);
+    if (type->fixed_last)
+        mapper_select(window_count() - 1, mapper.bank_count - 1);
+
+    printf("Loaded ROM: %s (%u banks of %u bytes, mapper %s)\n",
+           filename, mapper.bank_count, type->bank_size, type->name);
+    return 0;
+}
+
+void mapper_unload(void) {
+    if (mapper.image == NULL)
+        return;
+    if (mapper.mmapped)
+        munmap(mapper.image, mapper.size);
+    else
+        free(mapper.image);
+    memset(&mapper, 0, sizeof(mapper));
+    map_pages(current_bus->read_pages, ROM_START, ROM_SIZE, current_bus->rom);
+}
+
+void list_mappers(void) {
+    for (const MapperType *type = mapper_types; type->name; type++)
+        printf("  %-4s %s\n", type->name, type->description);
+}
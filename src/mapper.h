@@ -0,0 +1,35 @@
+#ifndef MAPPER_H
+#define MAPPER_H
+
+#include "../include/common.h"
+
+// Bank-switched cartridge images mapped into $8000-$FFFF. Writes to the
+// ROM range select banks; switching only rewrites the page pointers of
+// the affected window. The mapper state lives in the current bus.
+
+#define MAPPER_MAX_WINDOWS 4
+
+typedef struct {
+    const char *name;
+    const char *description;
+    uint32_t bank_size;     // Bytes per switchable bank
+    int fixed_last;         // Last window pinned to the last bank
+} MapperType;
+
+typedef struct {
+    const MapperType *type;
+    uint8_t *image;
+    size_t size;
+    int mmapped;
+    uint32_t bank_count;
+    uint32_t banks[MAPPER_MAX_WINDOWS];
+} Mapper;
+
+int mapper_load(const char *filename, const char *type_name);
+void mapper_unload(void);
+int mapper_active(void);
+void mapper_select(int window, uint32_t bank);
+void mapper_write(uint16_t address, uint8_t value);
+void list_mappers(void);
+
+#endif
@@ -1,45 +1,242 @@
 #include "memory.h"
+#include "busstats.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
 
 // Global memory arrays
 uint8_t memory[MEMORY_SIZE] = {0};
 uint8_t rom[ROM_SIZE] = {0};
 
-void initialize_memory() {
-    for (int i = 0; i < MEMORY_SIZE; i++) {
-        memory[i] = 0;
+Bus default_bus = { .ram = memory, .rom = rom };
+_Thread_local Bus *current_bus = &default_bus;
+
+void map_pages(uint8_t **pages, uint16_t start, uint32_t size, uint8_t *base) {
+    for (uint32_t offset = 0; offset < size; offset += MEMORY_PAGE_SIZE)
+        pages[(start + offset) >> 8] = base ? base + offset : NULL;
+}
+
+// Zeroed RAM, default memory map, no devices
+void bus_init(Bus *bus, uint8_t *ram, uint8_t *rom) {
+    memset(bus, 0, sizeof(*bus));
+    bus->ram = ram;
+    bus->rom = rom;
+    memset(ram, 0, MEMORY_SIZE);
+
+    // Zero page, stack and RAM, then its mirrors up to $1FFF
+    for (uint32_t mirror = 0x0000; mirror <= MIRRORED_RAM_END; mirror += 0x0800) {
+        map_pages(bus->read_pages, mirror, 0x0800, ram);
+        map_pages(bus->write_pages, mirror, 0x0800, ram);
     }
+    map_pages(bus->read_pages, ROM_START, ROM_SIZE, rom);
+}
+
+// Read-only backing for every untouched page of every sparse bus
+static uint8_t blank_page[MEMORY_PAGE_SIZE];
+
+// Pool of ROM pages shared by content, reference counted
+typedef struct SharedPage {
+    struct SharedPage *next;
+    uint32_t hash;
+    uint32_t references;
+    uint8_t data[MEMORY_PAGE_SIZE];
+} SharedPage;
+
+#define SHARED_PAGE_BUCKETS 4096
+
+static SharedPage *shared_pages[SHARED_PAGE_BUCKETS];
+static pthread_mutex_t shared_pages_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_long private_page_count;
+static atomic_long shared_page_count;
+static atomic_long shared_page_references;
+
+static int is_blank(const uint8_t *data) {
+    return data[0] == 0 && memcmp(data, data + 1, MEMORY_PAGE_SIZE - 1) == 0;
+}
+
+// FNV-1a
+static uint32_t hash_page(const uint8_t *data) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MEMORY_PAGE_SIZE; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+static uint8_t *share_page(const uint8_t *data) {
+    if (is_blank(data))
+        return blank_page;
+
+    uint32_t hash = hash_page(data);
+    SharedPage **bucket = &shared_pages[hash % SHARED_PAGE_BUCKETS];
+    pthread_mutex_lock(&shared_pages_lock);
+    SharedPage *page = *bucket;
+    while (page && (page->hash != hash || memcmp(page->data, data, MEMORY_PAGE_SIZE) != 0))
+        page = page->next;
+    if (page == NULL && (page = malloc(sizeof(SharedPage))) != NULL) {
+        page->hash = hash;
+        page->references = 0;
+        memcpy(page->data, data, MEMORY_PAGE_SIZE);
+        page->next = *bucket;
+        *bucket = page;
+        shared_page_count++;
+    }
+    if (page) {
+        page->references++;
+        shared_page_references++;
+    }
+    pthread_mutex_unlock(&shared_pages_lock);
+    return page ? page->data : NULL;
+}
+
+static void unshare_page(uint8_t *data) {
+    if (data == NULL || data == blank_page)
+        return;
+
+    SharedPage *page = (SharedPage *)(data - offsetof(SharedPage, data));
+    pthread_mutex_lock(&shared_pages_lock);
+    shared_page_references--;
+    if (--page->references == 0) {
+        SharedPage **link = &shared_pages[page->hash % SHARED_PAGE_BUCKETS];
+        while (*link != page)
+            link = &(*link)->next;
+        *link = page->next;
+        free(page);
+        shared_page_count--;
+    }
+    pthread_mutex_unlock(&shared_pages_lock);
+}
+
+// Gives RAM page <index> private storage, mapped at each of its mirrors
+static uint8_t *fault_ram_page(Bus *bus, int index) {
+    uint8_t *page = bus->private_ram[index];
+    if (page)
+        return page;
+    page = calloc(1, MEMORY_PAGE_SIZE);
+    if (page == NULL) {
+        printf("Error: Out of memory for a RAM page\n");
+        return NULL;
+    }
+    bus->private_ram[index] = page;
+    private_page_count++;
+    for (uint32_t mirror = 0x0000; mirror <= MIRRORED_RAM_END; mirror += 0x0800) {
+        bus->read_pages[(mirror >> 8) + index] = page;
+        bus->write_pages[(mirror >> 8) + index] = page;
+    }
+    return page;
+}
+
+// Sparse bus holding the RAM and ROM contents of <image>. Non-blank RAM
+// pages are copied; ROM pages come from the shared pool.
+int bus_init_sparse(Bus *bus, const Bus *image) {
+    memset(bus, 0, sizeof(*bus));
+    bus->sparse = 1;
+
+    for (int index = 0; index < RAM_PAGE_COUNT; index++) {
+        const uint8_t *source = image->read_pages[index];
+        for (uint32_t mirror = 0x0000; mirror <= MIRRORED_RAM_END; mirror += 0x0800)
+            bus->read_pages[(mirror >> 8) + index] = blank_page;
+        if (source && !is_blank(source)) {
+            uint8_t *page = fault_ram_page(bus, index);
+            if (page == NULL) {
+                bus_release(bus);
+                return -1;
+            }
+            memcpy(page, source, MEMORY_PAGE_SIZE);
+        }
+    }
+    for (int index = ROM_START >> 8; index < MEMORY_PAGE_COUNT; index++) {
+        if (image->read_pages[index] == NULL)
+            continue;
+        bus->read_pages[index] = share_page(image->read_pages[index]);
+        if (bus->read_pages[index] == NULL) {
+            printf("Error: Out of memory for a ROM page\n");
+            bus_release(bus);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void bus_release(Bus *bus) {
+    if (!bus->sparse)
+        return;
+    for (int index = 0; index < RAM_PAGE_COUNT; index++) {
+        if (bus->private_ram[index]) {
+            free(bus->private_ram[index]);
+            private_page_count--;
+        }
+    }
+    for (int index = ROM_START >> 8; index < MEMORY_PAGE_COUNT; index++)
+        unshare_page(bus->read_pages[index]);
+    memset(bus, 0, sizeof(*bus));
+}
+
+// $0000-RAM_END into <out>
+void bus_save_ram(const Bus *bus, uint8_t *out) {
+    for (int index = 0; index < RAM_PAGE_COUNT; index++)
+        memcpy(out + index * MEMORY_PAGE_SIZE, bus->read_pages[index], MEMORY_PAGE_SIZE);
+}
+
+void bus_restore_ram(Bus *bus, const uint8_t *in) {
+    for (int index = 0; index < RAM_PAGE_COUNT; index++) {
+        const uint8_t *source = in + index * MEMORY_PAGE_SIZE;
+        uint8_t *page = bus->write_pages[index];
+        if (page == NULL && bus->sparse && !is_blank(source))
+            page = fault_ram_page(bus, index);
+        if (page)
+            memcpy(page, source, MEMORY_PAGE_SIZE);
+    }
+}
+
+void bus_print_stats(void) {
+    long private_pages = private_page_count, shared = shared_page_count;
+    long references = shared_page_references;
+    printf("Memory pages: %ld private RAM, %ld shared ROM (%ld references), %ld KB\n",
+           private_pages, shared, references,
+           (private_pages + shared) * MEMORY_PAGE_SIZE / 1024);
+}
+
+// Resets the current bus
+void initialize_memory() {
+    mapper_unload();
+    bus_init(current_bus, current_bus->ram, current_bus->rom);
 }
 
 uint8_t read_memory(uint16_t address) {
-    if (address <= ZERO_PAGE_END) {
-        return memory[address];
-    } else if (address >= STACK_START && address <= STACK_END) {
-        return memory[address];
-    } else if (address >= RAM_START && address <= RAM_END) { 
-        return memory[address];
-    } else if (address >= MIRRORED_RAM_START && address <= MIRRORED_RAM_END) {
-        return memory[address % 0x0800];
+    BUS_STATS_READ(address);
+    uint8_t *page = current_bus->read_pages[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    } else if (current_bus->miss_read) {
+        return current_bus->miss_read(current_bus->miss_context, address);
     } else if (address >= IO_REGISTERS_START && address <= IO_REGISTERS_END) { 
         return handle_io_read(address);
-    } else if (address >= ROM_START && address <= ROM_END) { 
-        return rom[address - ROM_START];
     }
     return 0xFF;
 }
 
 // Write to memory
 void write_memory(uint16_t address, uint8_t value) {
-    if (address <= ZERO_PAGE_END) { 
-        memory[address] = value;
-    } else if (address >= STACK_START && address <= STACK_END) { 
-        memory[address] = value;
-    } else if (address >= RAM_START && address <= RAM_END) { 
-        memory[address] = value;
-    } else if (address >= MIRRORED_RAM_START && address <= MIRRORED_RAM_END) { 
-        memory[address % 0x0800] = value;
+    BUS_STATS_WRITE(address);
+    uint8_t *page = current_bus->write_pages[address >> 8];
+    if (page) {
+        page[address & 0xFF] = value;
+    } else if (current_bus->miss_write) {
+        current_bus->miss_write(current_bus->miss_context, address, value);
+    } else if (address <= MIRRORED_RAM_END && current_bus->sparse) {
+        // Zero into a blank page changes nothing; anything else gets a page
+        if (value == 0)
+            return;
+        page = fault_ram_page(current_bus, (address & RAM_END) >> 8);
+        if (page)
+            page[address & 0xFF] = value;
     } else if (address >= IO_REGISTERS_START && address <= IO_REGISTERS_END) { 
         handle_io_write(address, value);
-    } else if (address >= ROM_START && address <= ROM_END) { // ROM is read-only
+    } else if (address >= ROM_START && mapper_active()) { // Bank select
+        mapper_write(address, value);
+    } else if (address >= ROM_START) { // ROM is read-only
         printf("Warning: Attempt to write to ROM at address $%04X\n", address);
     }
 }
@@ -51,18 +248,56 @@ void load_rom(const char *filename) {
         return;
     }
 
-    fread(rom, sizeof(uint8_t), ROM_SIZE, file);
+    fread(current_bus->rom, sizeof(uint8_t), ROM_SIZE, file);
+    if (fgetc(file) != EOF)
+        printf("Warning: ROM %s is larger than 32 KB and was truncated; use a mapper\n", filename);
     fclose(file);
     printf("Loaded ROM: %s\n", filename);
 }
 
-// Placeholder for I/O read (to be implemented)
+int register_io_device(const IoDevice *device) {
+    if (current_bus->io_device_count == MAX_IO_DEVICES) {
+        printf("Error: Too many I/O devices\n");
+        return -1;
+    }
+    if (device->start < IO_REGISTERS_START || device->end > IO_REGISTERS_END ||
+        device->start > device->end) {
+        printf("Error: I/O device range $%04X-$%04X is outside the I/O registers\n",
+               device->start, device->end);
+        return -1;
+    }
+    current_bus->io_devices[current_bus->io_device_count++] = *device;
+    return 0;
+}
+
+static IoDevice *find_io_device(uint16_t address) {
+    for (int i = 0; i < current_bus->io_device_count; i++) {
+        IoDevice *device = &current_bus->io_devices[i];
+        if (address >= device->start && address <= device->end)
+            return device;
+    }
+    return NULL;
+}
+
 uint8_t handle_io_read(uint16_t address) {
+    BUS_STATS_IO_READ(address);
+    METRICS_ADD(io_reads, 1);
+    IoDevice *device = find_io_device(address);
+    if (device && device->read)
+        return device->read(device->context, address);
+
     printf("Reading from I/O register $%04X\n", address);
     return 0x00;
 }
 
-// Placeholder for I/O write (to be implemented)
 void handle_io_write(uint16_t address, uint8_t value) {
+    BUS_STATS_IO_WRITE(address);
+    METRICS_ADD(io_writes, 1);
+    IoDevice *device = find_io_device(address);
+    if (device && device->write) {
+        device->write(device->context, address, value);
+        return;
+    }
+
     printf("Writing value $%02X to I/O register $%04X\n", value, address);
 }
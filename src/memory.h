@@ -1,15 +1,63 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 #include "../include/common.h"
+#include "mapper.h"
+
+#define MAX_IO_DEVICES 16
+#define RAM_PAGE_COUNT ((RAM_END + 1) / MEMORY_PAGE_SIZE)
+
+// Memory-mapped device occupying [start, end] of the I/O register range
+typedef struct {
+    uint16_t start;
+    uint16_t end;
+    uint8_t (*read)(void *context, uint16_t address);
+    void (*write)(void *context, uint16_t address, uint8_t value);
+    void *context;
+} IoDevice;
+
+// Address space of one machine. read_memory()/write_memory() decode
+// through the bus current on the calling thread, so the CPU handlers stay
+// free of machine pointers while many machines run side by side.
+typedef struct {
+    // One entry per 256-byte page. NULL sends the access to the slow path
+    // (I/O registers, ROM writes, unmapped space).
+    uint8_t *read_pages[MEMORY_PAGE_COUNT];
+    uint8_t *write_pages[MEMORY_PAGE_COUNT];
+    uint8_t *ram;                   // MEMORY_SIZE bytes; NULL on a sparse bus
+    uint8_t *rom;                   // ROM_SIZE bytes; NULL on a sparse bus
+    // Sparse bus: RAM pages are allocated on the first non-zero write and
+    // read the shared blank page until then; ROM pages are shared between
+    // buses with the same contents
+    int sparse;
+    uint8_t *private_ram[RAM_PAGE_COUNT];
+    // Optional handler for every access that misses the page tables, ahead
+    // of the RAM/I/O/ROM slow paths (per-CPU views of a shared bus)
+    uint8_t (*miss_read)(void *context, uint16_t address);
+    void (*miss_write)(void *context, uint16_t address, uint8_t value);
+    void *miss_context;
+    IoDevice io_devices[MAX_IO_DEVICES];
+    int io_device_count;
+    Mapper mapper;
+} Bus;
 
 extern uint8_t memory[MEMORY_SIZE];
 extern uint8_t rom[ROM_SIZE];
+extern Bus default_bus;             // Backed by memory[] and rom[]
+extern _Thread_local Bus *current_bus;
 
 // Function prototypes
 void initialize_memory();
+void bus_init(Bus *bus, uint8_t *ram, uint8_t *rom);
+int bus_init_sparse(Bus *bus, const Bus *image);
+void bus_release(Bus *bus);
+void bus_save_ram(const Bus *bus, uint8_t *out);
+void bus_restore_ram(Bus *bus, const uint8_t *in);
+void bus_print_stats(void);
+void map_pages(uint8_t **pages, uint16_t start, uint32_t size, uint8_t *base);
 uint8_t read_memory(uint16_t address);
 void write_memory(uint16_t address, uint8_t value);
 void load_rom(const char *filename);
+int register_io_device(const IoDevice *device);
 uint8_t handle_io_read(uint16_t address);
 void handle_io_write(uint16_t address, uint8_t value);
 
@@ -0,0 +1,245 @@
+#define _POSIX_C_SOURCE 200809L
+#include "metrics.h"
+#include <errno.h>
+#include <stddef.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+_Thread_local MetricsCounters *current_metrics = NULL;
+
+static MetricsCounters *registered = NULL;
+static MetricsCounters retired;        // Totals of unregistered blocks, so aggregates never drop
+static int registered_count = 0;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *export_path = NULL;
+static int export_socket = -1;
+static int export_interval = 5;
+static int exporter_running = 0;
+static int stopping = 0;
+static pthread_t exporter;
+static pthread_mutex_t exporter_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t exporter_wakeup = PTHREAD_COND_INITIALIZER;
+
+// Previous snapshot, for the instruction rate
+static uint64_t last_instructions = 0;
+static double last_time = 0;
+
+void metrics_register(MetricsCounters *counters, const char *label) {
+    snprintf(counters->label, sizeof(counters->label), "%s", label);
+    pthread_mutex_lock(&registry_lock);
+    counters->previous = NULL;
+    counters->next = registered;
+    if (registered)
+        registered->previous = counters;
+    registered = counters;
+    registered_count++;
+    pthread_mutex_unlock(&registry_lock);
+}
+
+void metrics_unregister(MetricsCounters *counters) {
+    pthread_mutex_lock(&registry_lock);
+    if (counters->previous)
+        counters->previous->next = counters->next;
+    else
+        registered = counters->next;
+    if (counters->next)
+        counters->next->previous = counters->previous;
+    registered_count--;
+    retired.instructions += counters->instructions;
+    retired.cycles += counters->cycles;
+    retired.unknown_opcodes += counters->unknown_opcodes;
+    retired.io_reads += counters->io_reads;
+    retired.io_writes += counters->io_writes;
+    retired.stall_cycles += counters->stall_cycles;
+    retired.parks += counters->parks;
+    pthread_mutex_unlock(&registry_lock);
+}
+
+typedef struct {
+    const char *name;
+    const char *help;
+    size_t offset;
+} MetricField;
+
+static const MetricField fields[] = {
+    { "instructions", "Instructions retired", offsetof(MetricsCounters, instructions) },
+    { "cycles", "CPU cycles", offsetof(MetricsCounters, cycles) },
+    { "unknown_opcodes", "Undecoded opcodes executed", offsetof(MetricsCounters, unknown_opcodes) },
+    { "io_reads", "I/O register reads", offsetof(MetricsCounters, io_reads) },
+    { "io_writes", "I/O register writes", offsetof(MetricsCounters, io_writes) },
+    { "stall_cycles", "Cycles charged by devices", offsetof(MetricsCounters, stall_cycles) },
+    { "parks", "Times parked by the scheduler", offsetof(MetricsCounters, parks) },
+};
+
+static uint64_t field_value(const MetricsCounters *counters, const MetricField *field) {
+    return atomic_load_explicit((_Atomic uint64_t *)((char *)counters + field->offset),
+                                memory_order_relaxed);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_snapshot(FILE *out) {
+    pthread_mutex_lock(&registry_lock);
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+        const MetricField *field = &fields[f];
+        uint64_t total = field_value(&retired, field);
+        for (MetricsCounters *c = registered; c; c = c->next)
+            total += field_value(c, field);
+
+        fprintf(out, "# HELP mos6502_%s_total %s.\n# TYPE mos6502_%s_total counter\n",
+                field->name, field->help, field->name);
+        fprintf(out, "mos6502_%s_total %llu\n", field->name, (unsigned long long)total);
+        fprintf(out, "# HELP mos6502_machine_%s_total %s, per machine.\n"
+                     "# TYPE mos6502_machine_%s_total counter\n",
+                field->name, field->help, field->name);
+        for (MetricsCounters *c = registered; c; c = c->next)
+            fprintf(out, "mos6502_machine_%s_total{machine=\"%s\"} %llu\n", field->name,
+                    c->label, (unsigned long long)field_value(c, field));
+
+        if (field->offset == offsetof(MetricsCounters, instructions)) {
+            double time = now_seconds();
+            double rate = last_time > 0 && time > last_time
+                              ? (total - last_instructions) / (time - last_time) : 0;
+            last_instructions = total;
+            last_time = time;
+            fprintf(out, "# HELP mos6502_instructions_per_second Rate since the last export.\n"
+                         "# TYPE mos6502_instructions_per_second gauge\n"
+                         "mos6502_instructions_per_second %.0f\n", rate);
+        }
+    }
+    fprintf(out, "# HELP mos6502_machines Machines registered.\n# TYPE mos6502_machines gauge\n"
+                 "mos6502_machines %d\n", registered_count);
+    pthread_mutex_unlock(&registry_lock);
+}
+
+// Written next to the target and renamed, so readers never see half a file
+static void export_file(void) {
+    char temporary[512];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", export_path);
+    FILE *file = fopen(temporary, "w");
+    if (file == NULL)
+        return;
+    write_snapshot(file);
+    fclose(file);
+    rename(temporary, export_path);
+}
+
+// One snapshot per connection, then close
+static void serve_socket(int timeout_ms) {
+    struct pollfd pfd = { export_socket, POLLIN, 0 };
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+        return;
+    int client = accept(export_socket, NULL, NULL);
+    if (client < 0)
+        return;
+    FILE *out = fdopen(client, "w");
+    if (out == NULL) {
+        close(client);
+        return;
+    }
+    write_snapshot(out);
+    fclose(out);
+}
+
+static void *exporter_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&exporter_lock);
+    while (!stopping) {
+        pthread_mutex_unlock(&exporter_lock);
+        if (export_socket >= 0) {
+            serve_socket(200);
+        } else {
+            export_file();
+        }
+        pthread_mutex_lock(&exporter_lock);
+        if (export_socket < 0 && !stopping) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += export_interval;
+            pthread_cond_timedwait(&exporter_wakeup, &exporter_lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&exporter_lock);
+    return NULL;
+}
+
+static int open_socket(const char *path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Error: Metrics socket path %s is too long\n", path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        printf("Error: Unable to create the metrics socket: %s\n", strerror(errno));
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 8) < 0) {
+        printf("Error: Unable to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// <target> is a file rewritten every <interval_seconds>, or
+// "unix:<path>" for a socket that answers every connection with a snapshot
+int metrics_start(const char *target, int interval_seconds) {
+    if (exporter_running)
+        return 0;
+    export_interval = interval_seconds > 0 ? interval_seconds : 5;
+    if (strncmp(target, "unix:", 5) == 0) {
+        export_path = target + 5;
+        export_socket = open_socket(export_path);
+        if (export_socket < 0)
+            return -1;
+    } else {
+        export_path = target;
+    }
+    stopping = 0;
+    if (pthread_create(&exporter, NULL, exporter_main, NULL) != 0) {
+        printf("Error: Unable to start the metrics exporter\n");
+        return -1;
+    }
+    exporter_running = 1;
+    atexit(metrics_stop);
+    return 0;
+}
+
+int metrics_enabled(void) {
+    return exporter_running;
+}
+
+// Final export for files; the socket is removed
+void metrics_stop(void) {
+    if (!exporter_running)
+        return;
+    pthread_mutex_lock(&exporter_lock);
+    stopping = 1;
+    pthread_cond_signal(&exporter_wakeup);
+    pthread_mutex_unlock(&exporter_lock);
+    pthread_join(exporter, NULL);
+    exporter_running = 0;
+
+    if (export_socket >= 0) {
+        close(export_socket);
+        unlink(export_path);
+        export_socket = -1;
+    } else {
+        export_file();
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "../include/common.h"
+#include <stdatomic.h>
+
+// Runtime counters for long-running processes, exported in Prometheus
+// text format to a file or a Unix socket.
+//
+// Each machine owns a MetricsCounters block. The instruction loops count
+// locally and publish once per quantum, window or flush interval; rare
+// events (unknown opcodes, I/O, stalls) are added where they happen to the
+// block of the machine running on the calling thread. All updates are
+// relaxed atomics; the exporter thread only reads.
+
+typedef struct MetricsCounters {
+    _Atomic uint64_t instructions;
+    _Atomic uint64_t cycles;            // Last published cycle count
+    _Atomic uint64_t unknown_opcodes;
+    _Atomic uint64_t io_reads;
+    _Atomic uint64_t io_writes;
+    _Atomic uint64_t stall_cycles;      // Cycles charged by devices (DMA)
+    _Atomic uint64_t parks;             // Scheduler parks
+    char label[16];
+    struct MetricsCounters *next;
+    struct MetricsCounters *previous;
+} MetricsCounters;
+
+// Block of the machine running on this thread, NULL when none
+extern _Thread_local MetricsCounters *current_metrics;
+
+#define METRICS_ADD(field, amount) do { \
+        if (current_metrics) \
+            atomic_fetch_add_explicit(&current_metrics->field, (amount), memory_order_relaxed); \
+    } while (0)
+
+// Instructions retired since the last publish, and the current cycle count
+static inline void metrics_publish(MetricsCounters *counters, uint64_t instructions,
+                                   uint64_t cycles) {
+    atomic_fetch_add_explicit(&counters->instructions, instructions, memory_order_relaxed);
+    atomic_store_explicit(&counters->cycles, cycles, memory_order_relaxed);
+}
+
+#define METRICS_FLUSH_INTERVAL 4096   // Instructions between publishes in the main loop
+
+void metrics_register(MetricsCounters *counters, const char *label);
+void metrics_unregister(MetricsCounters *counters);
+int metrics_start(const char *target, int interval_seconds);
+int metrics_enabled(void);
+void metrics_stop(void);
+
+#endif
@@ -0,0 +1,132 @@
+#include "../include/mos6502.h"
+#include "memory.h"
+#include "variants.h"
+#include <string.h>
+
+struct Mos6502 {
+    CPU cpu;
+    Bus bus;
+    ExecuteFunction step;
+    uint8_t ram[MEMORY_SIZE];
+    uint8_t rom[ROM_SIZE];
+};
+
+int mos6502_api_version(void) {
+    return MOS6502_API_VERSION;
+}
+
+Mos6502 *mos6502_create(const char *variant) {
+    ExecuteFunction step = execute;
+    if (variant && strcmp(variant, "reference") != 0) {
+        const CpuVariant *found = find_cpu_variant(variant);
+        if (found == NULL)
+            return NULL;
+        step = found->execute;
+    }
+
+    Mos6502 *machine = calloc(1, sizeof(Mos6502));
+    if (machine == NULL)
+        return NULL;
+    machine->step = step;
+    bus_init(&machine->bus, machine->ram, machine->rom);
+    reset_cpu(&machine->cpu);
+    return machine;
+}
+
+void mos6502_destroy(Mos6502 *machine) {
+    free(machine);
+}
+
+// The callbacks have the bus miss hook signature, so read_memory() calls
+// the host directly
+void mos6502_set_bus(Mos6502 *machine, Mos6502Read read, Mos6502Write write, void *context) {
+    if (read == NULL && write == NULL) {
+        bus_init(&machine->bus, machine->ram, machine->rom);
+        return;
+    }
+    memset(machine->bus.read_pages, 0, sizeof(machine->bus.read_pages));
+    memset(machine->bus.write_pages, 0, sizeof(machine->bus.write_pages));
+    machine->bus.miss_read = read;
+    machine->bus.miss_write = write;
+    machine->bus.miss_context = context;
+}
+
+int mos6502_map(Mos6502 *machine, uint16_t address, uint32_t size, uint8_t *memory,
+                int writable) {
+    if ((address | size) % MEMORY_PAGE_SIZE != 0 || address + size > MEMORY_SIZE || memory == NULL)
+        return -1;
+    map_pages(machine->bus.read_pages, address, size, memory);
+    if (writable) {
+        map_pages(machine->bus.write_pages, address, size, memory);
+    } else {
+        for (uint32_t page = address >> 8; page < (address + size) >> 8; page++)
+            machine->bus.write_pages[page] = NULL;
+    }
+    return 0;
+}
+
+int mos6502_load(Mos6502 *machine, const uint8_t *image, size_t size, uint16_t address) {
+    int result = 0;
+    for (size_t i = 0; i < size && address + i < MEMORY_SIZE; i++) {
+        uint16_t target = address + i;
+        uint8_t *page = machine->bus.write_pages[target >> 8];
+        if (page == NULL)
+            page = machine->bus.read_pages[target >> 8];
+        if (page)
+            page[target & 0xFF] = image[i];
+        else if (machine->bus.miss_write)
+            machine->bus.miss_write(machine->bus.miss_context, target, image[i]);
+        else
+            result = -1;
+    }
+    return result;
+}
+
+uint64_t mos6502_run(Mos6502 *machine, uint64_t cycles) {
+    Bus *saved = current_bus;
+    CPU *cpu = &machine->cpu;
+    uint64_t start = cpu->cycles;
+
+    current_bus = &machine->bus;
+    while (cpu->is_running && cpu->cycles - start < cycles)
+        machine->step(cpu, machine->bus.ram);
+    current_bus = saved;
+    return cpu->cycles - start;
+}
+
+void mos6502_get_state(const Mos6502 *machine, Mos6502State *state) {
+    state->a = machine->cpu.A;
+    state->x = machine->cpu.X;
+    state->y = machine->cpu.Y;
+    state->sp = machine->cpu.SP;
+    state->status = machine->cpu.status;
+    state->running = machine->cpu.is_running;
+    state->pc = machine->cpu.PC;
+    state->cycles = machine->cpu.cycles;
+}
+
+void mos6502_set_state(Mos6502 *machine, const Mos6502State *state) {
+    machine->cpu.A = state->a;
+    machine->cpu.X = state->x;
+    machine->cpu.Y = state->y;
+    machine->cpu.SP = state->sp;
+    machine->cpu.status = state->status;
+    machine->cpu.is_running = state->running;
+    machine->cpu.PC = state->pc;
+    machine->cpu.cycles = state->cycles;
+}
+
+uint8_t mos6502_peek(Mos6502 *machine, uint16_t address) {
+    Bus *saved = current_bus;
+    current_bus = &machine->bus;
+    uint8_t value = read_memory(address);
+    current_bus = saved;
+    return value;
+}
+
+void mos6502_poke(Mos6502 *machine, uint16_t address, uint8_t value) {
+    Bus *saved = current_bus;
+    current_bus = &machine->bus;
+    write_memory(address, value);
+    current_bus = saved;
+}
@@ -0,0 +1,342 @@
+#define _POSIX_C_SOURCE 200809L
+#include "network.h"
+#include "mapper.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t arrival;       // Receiver cycle count from which the byte is visible
+    uint8_t value;
+} LinkByte;
+
+typedef struct {
+    LinkByte *items;
+    size_t head;
+    size_t count;           // Including the consumed items before head
+    size_t capacity;
+} LinkQueue;
+
+typedef struct NetworkNode NetworkNode;
+
+typedef struct {
+    NetworkNode *peer;
+    int peer_port;
+    LinkQueue pending;      // Written by the peer during the current window
+    LinkQueue received;     // Delivered at the last barrier, in arrival order
+} LinkPort;
+
+struct NetworkNode {
+    Machine *machine;
+    int port_count;
+    LinkPort ports[LINK_MAX_PORTS];
+    int idle;               // Stuck on an instruction that jumps to itself
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t bytes_dropped;
+};
+
+static NetworkNode *nodes = NULL;
+static int node_count = 0;
+static int link_count = 0;
+static uint64_t link_latency = NETWORK_DEFAULT_LATENCY;
+
+// Run state, written by the barrier's serial thread between barriers
+static pthread_barrier_t barrier;
+static int thread_count = 1;
+static uint64_t window_end = 0;
+static uint64_t cycle_limit = 0;
+static uint64_t windows = 0;
+static int finished = 0;
+
+static int queue_push(LinkQueue *queue, uint64_t arrival, uint8_t value) {
+    if (queue->count == queue->capacity) {
+        if (queue->head > 0) { // Reclaim consumed items before growing
+            memmove(queue->items, queue->items + queue->head,
+                    (queue->count - queue->head) * sizeof(LinkByte));
+            queue->count -= queue->head;
+            queue->head = 0;
+        }
+        if (queue->count == queue->capacity) {
+            size_t capacity = queue->capacity ? queue->capacity * 2 : 64;
+            LinkByte *grown = realloc(queue->items, capacity * sizeof(LinkByte));
+            if (grown == NULL)
+                return -1;
+            queue->items = grown;
+            queue->capacity = capacity;
+        }
+    }
+    queue->items[queue->count++] = (LinkByte){ arrival, value };
+    return 0;
+}
+
+static const LinkByte *queue_peek(const LinkQueue *queue) {
+    return queue->head < queue->count ? &queue->items[queue->head] : NULL;
+}
+
+static void queue_free(LinkQueue *queue) {
+    free(queue->items);
+    memset(queue, 0, sizeof(*queue));
+}
+
+static uint8_t link_read(void *context, uint16_t address) {
+    NetworkNode *node = context;
+    int reg = address - LINK_BASE;
+
+    if (reg == LINK_NODE_ID)
+        return node->machine->id;
+    if (reg == LINK_PORT_COUNT)
+        return node->port_count;
+    if (reg < LINK_PORT(0))
+        return 0x00;
+
+    int port_index = (reg - LINK_PORT(0)) / 4;
+    if (port_index >= node->port_count)
+        return 0x00;
+    LinkQueue *received = &node->ports[port_index].received;
+    const LinkByte *next = queue_peek(received);
+    int ready = next && next->arrival <= node->machine->cpu.cycles;
+
+    switch ((reg - LINK_PORT(0)) % 4) {
+        case LINK_DATA:
+            if (!ready)
+                return 0x00;
+            received->head++;
+            node->bytes_received++;
+            return next->value;
+        case LINK_STATUS:
+            return (ready ? LINK_STATUS_RX_READY : 0) | LINK_STATUS_TX_READY;
+        default:
+            return 0x00;
+    }
+}
+
+static void link_write(void *context, uint16_t address, uint8_t value) {
+    NetworkNode *node = context;
+    int reg = address - LINK_BASE;
+    if (reg < LINK_PORT(0) || (reg - LINK_PORT(0)) % 4 != LINK_DATA)
+        return;
+
+    int port_index = (reg - LINK_PORT(0)) / 4;
+    if (port_index >= node->port_count)
+        return;
+    LinkPort *port = &node->ports[port_index];
+    LinkPort *peer_port = &port->peer->ports[port->peer_port];
+    if (queue_push(&peer_port->pending, node->machine->cpu.cycles + link_latency, value) < 0)
+        node->bytes_dropped++;
+    else
+        node->bytes_sent++;
+}
+
+// Reads "<node> <node>" lines, one per link. Ports are numbered per node in
+// the order its links appear.
+int network_load(const char *filename, int count, const Bus *image, uint16_t start,
+                 ExecuteFunction step) {
+    if (mapper_active()) {
+        printf("Error: Networks do not support mappers\n");
+        return -1;
+    }
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error: Unable to open network file %s\n", filename);
+        return -1;
+    }
+    if (count < 1 || count > 256) {
+        printf("Error: A network needs 1-256 nodes\n");
+        fclose(file);
+        return -1;
+    }
+
+    nodes = calloc(count, sizeof(NetworkNode));
+    if (nodes == NULL) {
+        printf("Error: Out of memory for %d nodes\n", count);
+        fclose(file);
+        return -1;
+    }
+    node_count = count;
+    link_count = 0;
+
+    char line[128];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        int a, b;
+        line_number++;
+        if (line[0] == '#' || sscanf(line, "%d %d", &a, &b) != 2)
+            continue;
+        if (a < 0 || b < 0 || a >= count || b >= count || a == b) {
+            printf("Error: %s:%d: bad link %d-%d\n", filename, line_number, a, b);
+            goto fail;
+        }
+        if (nodes[a].port_count == LINK_MAX_PORTS || nodes[b].port_count == LINK_MAX_PORTS) {
+            printf("Error: %s:%d: more than %d links on a node\n", filename, line_number,
+                   LINK_MAX_PORTS);
+            goto fail;
+        }
+        int port_a = nodes[a].port_count++, port_b = nodes[b].port_count++;
+        nodes[a].ports[port_a].peer = &nodes[b];
+        nodes[a].ports[port_a].peer_port = port_b;
+        nodes[b].ports[port_b].peer = &nodes[a];
+        nodes[b].ports[port_b].peer_port = port_a;
+        link_count++;
+    }
+    fclose(file);
+    file = NULL;
+
+    Bus *saved = current_bus;
+    for (int i = 0; i < count; i++) {
+        nodes[i].machine = machine_create(i, image, start, step);
+        if (nodes[i].machine == NULL)
+            goto fail;
+        current_bus = &nodes[i].machine->bus;
+        IoDevice device = { LINK_BASE, LINK_BASE + LINK_REGISTER_COUNT - 1,
+                            link_read, link_write, &nodes[i] };
+        int registered = register_io_device(&device);
+        current_bus = saved;
+        if (registered < 0)
+            goto fail;
+    }
+    return 0;
+
+fail:
+    if (file)
+        fclose(file);
+    network_free();
+    return -1;
+}
+
+static void run_node(NetworkNode *node, uint64_t end) {
+    Machine *machine = node->machine;
+    CPU *cpu = &machine->cpu;
+
+    uint64_t instructions = 0;
+
+    current_bus = &machine->bus;
+    current_metrics = &machine->metrics;
+    while (cpu->is_running && !node->idle && cpu->cycles < end) {
+        uint16_t pc = cpu->PC;
+        machine->step(cpu, machine->bus.ram);
+        instructions++;
+        if (cpu->PC == pc) // Only its own writes reach the RAM it polls
+            node->idle = 1;
+    }
+    metrics_publish(&machine->metrics, instructions, cpu->cycles);
+    current_metrics = NULL;
+    current_bus = &default_bus;
+}
+
+// Moves what peers sent during the window into the receive queues. A port
+// has one sender whose timestamps only grow, so appending keeps the queue
+// in arrival order.
+static void deliver(NetworkNode *node) {
+    for (int p = 0; p < node->port_count; p++) {
+        LinkPort *port = &node->ports[p];
+        for (size_t i = port->pending.head; i < port->pending.count; i++) {
+            const LinkByte *byte = &port->pending.items[i];
+            if (queue_push(&port->received, byte->arrival, byte->value) < 0)
+                node->bytes_dropped++;
+        }
+        port->pending.head = port->pending.count = 0;
+    }
+}
+
+static void *network_worker(void *arg) {
+    int thread = (int)(intptr_t)arg;
+
+    for (;;) {
+        uint64_t end = window_end;
+        for (int i = thread; i < node_count; i += thread_count)
+            run_node(&nodes[i], end);
+
+        if (pthread_barrier_wait(&barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+            int live = 0;
+            for (int i = 0; i < node_count; i++)
+                live += nodes[i].machine->cpu.is_running && !nodes[i].idle;
+            windows++;
+            finished = live == 0 || (cycle_limit && window_end >= cycle_limit);
+            window_end += link_latency;
+        }
+        for (int i = thread; i < node_count; i += thread_count)
+            deliver(&nodes[i]);
+        pthread_barrier_wait(&barrier);
+        if (finished)
+            return NULL;
+    }
+}
+
+// Runs until every node halts or idles, or <max_cycles> (0: no limit)
+int network_run(int threads, uint64_t latency, uint64_t max_cycles) {
+    if (nodes == NULL)
+        return -1;
+    if (threads < 1)
+        threads = 1;
+    if (threads > node_count)
+        threads = node_count;
+
+    pthread_t workers[threads];
+    thread_count = threads;
+    link_latency = latency ? latency : NETWORK_DEFAULT_LATENCY;
+    cycle_limit = max_cycles;
+    window_end = link_latency;
+    windows = 0;
+    finished = 0;
+    if (pthread_barrier_init(&barrier, NULL, threads) != 0) {
+        printf("Error: Unable to create the network barrier\n");
+        return -1;
+    }
+
+    int started = 1;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, network_worker,
+                           (void *)(intptr_t)started) != 0)
+            break;
+    }
+    if (started < threads) { // The barrier counts on every thread
+        printf("Error: Unable to start network thread %d\n", started);
+        exit(1);
+    }
+    network_worker((void *)(intptr_t)0);
+    for (int i = 1; i < threads; i++)
+        pthread_join(workers[i], NULL);
+    pthread_barrier_destroy(&barrier);
+    return 0;
+}
+
+Machine *network_node(int id) {
+    return id >= 0 && id < node_count ? nodes[id].machine : NULL;
+}
+
+void network_print_stats(void) {
+    uint64_t sent = 0, received = 0, dropped = 0;
+    for (int i = 0; i < node_count; i++) {
+        sent += nodes[i].bytes_sent;
+        received += nodes[i].bytes_received;
+        dropped += nodes[i].bytes_dropped;
+    }
+    printf("Network: %d nodes, %d links, %llu windows of %llu cycles on %d threads\n",
+           node_count, link_count, (unsigned long long)windows,
+           (unsigned long long)link_latency, thread_count);
+    printf("Link bytes: %llu sent, %llu received, %llu dropped\n",
+           (unsigned long long)sent, (unsigned long long)received,
+           (unsigned long long)dropped);
+    for (int i = 0; i < node_count && node_count <= 16; i++) {
+        const NetworkNode *node = &nodes[i];
+        const CPU *cpu = &node->machine->cpu;
+        printf("Node %d: %s at $%04X, A=%02X, %llu cycles, %llu sent, %llu received\n", i,
+               !cpu->is_running ? "halted" : node->idle ? "idle" : "running", cpu->PC, cpu->A,
+               (unsigned long long)cpu->cycles, (unsigned long long)node->bytes_sent,
+               (unsigned long long)node->bytes_received);
+    }
+}
+
+void network_free(void) {
+    for (int i = 0; i < node_count; i++) {
+        for (int p = 0; p < nodes[i].port_count; p++) {
+            queue_free(&nodes[i].ports[p].pending);
+            queue_free(&nodes[i].ports[p].received);
+        }
+        machine_destroy(nodes[i].machine);
+    }
+    free(nodes);
+    nodes = NULL;
+    node_count = 0;
+}
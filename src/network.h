@@ -0,0 +1,36 @@
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include "machine.h"
+
+// Clusters of machines joined by point-to-point serial links.
+//
+// Each node has a link device in its I/O range. A byte written to a
+// port's DATA register reaches the peer <latency> cycles later, measured
+// on the sender's cycle count. Nodes run in parallel in windows of
+// <latency> cycles: nothing sent inside a window can arrive before the
+// next one. Threads only meet at the window barriers, and the result does
+// not depend on the thread count.
+
+#define LINK_BASE          0x2200
+#define LINK_NODE_ID       0x00   // Read: this node's number
+#define LINK_PORT_COUNT    0x01   // Read: ports connected
+#define LINK_PORT(p)       (0x10 + (p) * 4)
+#define LINK_DATA          0x00   // Read: next received byte; write: send
+#define LINK_STATUS        0x01
+#define LINK_MAX_PORTS     8
+#define LINK_REGISTER_COUNT LINK_PORT(LINK_MAX_PORTS)
+
+#define LINK_STATUS_RX_READY 0x01
+#define LINK_STATUS_TX_READY 0x02
+
+#define NETWORK_DEFAULT_LATENCY 1000
+
+int network_load(const char *filename, int node_count, const Bus *image, uint16_t start,
+                 ExecuteFunction step);
+int network_run(int threads, uint64_t latency, uint64_t max_cycles);
+Machine *network_node(int id);
+void network_print_stats(void);
+void network_free(void);
+
+#endif
@@ -0,0 +1,15 @@
+#include "opcodes.h"
+
+const OpcodeInfo opcode_table[256] = {
+#define OPCODE(code, mnemonic, mode, cycles, variants, handler) \
+    [code] = { #mnemonic, MODE_##mode, MODE_LENGTH(MODE_##mode), cycles, variants, #handler },
+#include "opcodes.def"
+#undef OPCODE
+};
+
+const OpcodeDescriptor nmos_opcode_table[256] = {
+#define NMOS_OPCODE(code, mnemonic, mode, variants) \
+    [code] = { #mnemonic, MODE_##mode, MODE_LENGTH(MODE_##mode), variants },
+#include "nmos.def"
+#undef NMOS_OPCODE
+};
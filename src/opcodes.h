@@ -0,0 +1,56 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include "../include/common.h"
+
+typedef enum {
+    MODE_IMPLIED,
+    MODE_ACCUMULATOR,
+    MODE_IMMEDIATE,
+    MODE_ZERO_PAGE,
+    MODE_ZERO_PAGE_X,
+    MODE_ZERO_PAGE_Y,
+    MODE_ABSOLUTE,
+    MODE_ABSOLUTE_X,
+    MODE_ABSOLUTE_Y,
+    MODE_INDIRECT,
+    MODE_INDEXED_INDIRECT,   // ($nn, X)
+    MODE_INDIRECT_INDEXED,   // ($nn), Y
+    MODE_ZERO_PAGE_INDIRECT, // ($nn), 65C02
+    MODE_RELATIVE
+} AddressingMode;
+
+// Instruction length in bytes, opcode included
+#define MODE_LENGTH(mode) \
+    ((mode) == MODE_IMPLIED || (mode) == MODE_ACCUMULATOR ? 1 : \
+     (mode) == MODE_ABSOLUTE || (mode) == MODE_ABSOLUTE_X || \
+     (mode) == MODE_ABSOLUTE_Y || (mode) == MODE_INDIRECT ? 3 : 2)
+
+// Opcode sets, see the variants column of opcodes.def
+#define OPS_OFFICIAL   0x01
+#define OPS_ILLEGAL    0x02
+#define OPS_65C02      0x04
+#define OPS_LEGACY     0x08
+
+typedef struct {
+    const char *mnemonic;   // NULL for opcodes execute() does not decode
+    uint8_t mode;
+    uint8_t length;
+    uint8_t cycles;
+    uint8_t variants;
+    const char *handler;    // Handler call as written in opcodes.def
+} OpcodeInfo;
+
+extern const OpcodeInfo opcode_table[256];
+
+// Every NMOS opcode as the silicon decodes it, see nmos.def
+typedef struct {
+    const char *mnemonic;
+    uint8_t mode;
+    uint8_t length;
+    uint8_t variants;       // OPS_OFFICIAL or OPS_ILLEGAL
+} OpcodeDescriptor;
+
+extern const OpcodeDescriptor nmos_opcode_table[256];
+
+#endif
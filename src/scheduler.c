@@ -0,0 +1,292 @@
+#define _POSIX_C_SOURCE 200809L
+#include "scheduler.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t all_idle = PTHREAD_COND_INITIALIZER;
+
+static pthread_t workers[SCHEDULER_MAX_THREADS];
+static int worker_count = 0;
+static uint64_t quantum_cycles = SCHEDULER_DEFAULT_QUANTUM;
+static int stopping = 0;
+
+// FIFO run queue and the number of machines owned by workers
+static Machine *queue_head = NULL;
+static Machine *queue_tail = NULL;
+static int running_count = 0;
+
+// Every machine added, for statistics
+static Machine **machines = NULL;
+static int machine_count = 0;
+static int machine_capacity = 0;
+
+static _Thread_local Machine *current_machine = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Caller holds the lock
+static void enqueue(Machine *machine) {
+    machine->state = MACHINE_READY;
+    machine->next = NULL;
+    machine->ready_since_ns = now_ns();
+    if (queue_tail)
+        queue_tail->next = machine;
+    else
+        queue_head = machine;
+    queue_tail = machine;
+    pthread_cond_signal(&work_ready);
+}
+
+// Caller holds the lock and has checked the queue is not empty
+static Machine *dequeue(void) {
+    Machine *machine = queue_head;
+    queue_head = machine->next;
+    if (queue_head == NULL)
+        queue_tail = NULL;
+    machine->next = NULL;
+    return machine;
+}
+
+// Runs one quantum with the lock released. An instruction that leaves PC
+// where it was is an idle loop and parks the machine.
+static void run_quantum(Machine *machine) {
+    CPU *cpu = &machine->cpu;
+    uint64_t end = cpu->cycles + quantum_cycles;
+
+    uint64_t instructions = 0;
+
+    current_bus = &machine->bus;
+    current_machine = machine;
+    current_metrics = &machine->metrics;
+    while (cpu->is_running && cpu->cycles < end) {
+        uint16_t pc = cpu->PC;
+        machine->step(cpu, machine->bus.ram);
+        instructions++;
+        if (machine->park_requested)
+            break;
+        if (cpu->PC == pc) {
+            machine->park_requested = 1;
+            break;
+        }
+    }
+    metrics_publish(&machine->metrics, instructions, cpu->cycles);
+    current_metrics = NULL;
+    current_machine = NULL;
+    current_bus = &default_bus;
+}
+
+static void *worker_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (queue_head == NULL && !stopping)
+            pthread_cond_wait(&work_ready, &lock);
+        if (stopping)
+            break;
+
+        Machine *machine = dequeue();
+        uint64_t waited = now_ns() - machine->ready_since_ns;
+        machine->wait_ns_total += waited;
+        if (waited > machine->wait_ns_max)
+            machine->wait_ns_max = waited;
+        machine->state = MACHINE_RUNNING;
+        machine->quanta++;
+        running_count++;
+        pthread_mutex_unlock(&lock);
+
+        run_quantum(machine);
+
+        pthread_mutex_lock(&lock);
+        running_count--;
+        if (!machine->cpu.is_running) {
+            machine->state = MACHINE_HALTED;
+        } else if (machine->park_requested && !machine->wake_pending) {
+            machine->state = MACHINE_PARKED;
+            machine->parks++;
+            atomic_fetch_add_explicit(&machine->metrics.parks, 1, memory_order_relaxed);
+        } else {
+            enqueue(machine);
+        }
+        machine->park_requested = 0;
+        machine->wake_pending = 0;
+        if (queue_head == NULL && running_count == 0)
+            pthread_cond_broadcast(&all_idle);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+int scheduler_start(int threads, uint64_t quantum) {
+    if (threads < 1 || threads > SCHEDULER_MAX_THREADS) {
+        printf("Error: Scheduler needs 1-%d threads\n", SCHEDULER_MAX_THREADS);
+        return -1;
+    }
+    quantum_cycles = quantum ? quantum : SCHEDULER_DEFAULT_QUANTUM;
+    stopping = 0;
+    for (worker_count = 0; worker_count < threads; worker_count++) {
+        if (pthread_create(&workers[worker_count], NULL, worker_main, NULL) != 0) {
+            printf("Error: Unable to start scheduler thread %d\n", worker_count);
+            scheduler_shutdown();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Makes a new machine runnable. The caller keeps ownership.
+int scheduler_add(Machine *machine) {
+    pthread_mutex_lock(&lock);
+    if (machine_count == machine_capacity) {
+        int capacity = machine_capacity ? machine_capacity * 2 : 64;
+        Machine **grown = realloc(machines, capacity * sizeof(Machine *));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&lock);
+            printf("Error: Out of memory adding machine %d\n", machine->id);
+            return -1;
+        }
+        machines = grown;
+        machine_capacity = capacity;
+    }
+    machines[machine_count++] = machine;
+    enqueue(machine);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+// Safe from any thread, including device code of another machine
+void scheduler_wake(Machine *machine) {
+    pthread_mutex_lock(&lock);
+    if (machine->state == MACHINE_PARKED) {
+        machine->wakes++;
+        enqueue(machine);
+    } else if (machine->state == MACHINE_RUNNING) {
+        machine->wakes++;
+        machine->wake_pending = 1;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// For device code: park the machine executing on this thread once the
+// current instruction retires
+void scheduler_park_current(void) {
+    if (current_machine)
+        current_machine->park_requested = 1;
+}
+
+Machine *scheduler_current_machine(void) {
+    return current_machine;
+}
+
+// Blocks until no machine is runnable or running
+void scheduler_wait(void) {
+    pthread_mutex_lock(&lock);
+    while (queue_head != NULL || running_count > 0)
+        pthread_cond_wait(&all_idle, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+// Blocks until every machine has halted. Parked machines still count,
+// since device code on another thread (the serial bridge) may wake them.
+void scheduler_wait_halted(void) {
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (queue_head != NULL || running_count > 0)
+            pthread_cond_wait(&all_idle, &lock);
+        int halted = 0;
+        for (int i = 0; i < machine_count; i++)
+            halted += machines[i]->state == MACHINE_HALTED;
+        if (halted == machine_count)
+            break;
+        pthread_cond_wait(&all_idle, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+// Stops the workers after their current quantum. Machines stay allocated.
+void scheduler_shutdown(void) {
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+    for (int i = 0; i < worker_count; i++)
+        pthread_join(workers[i], NULL);
+    worker_count = 0;
+}
+
+// Fairness is Jain's index over the cycles of the machines that have not
+// halted (1.0 when every machine got the same share)
+void scheduler_print_stats(void) {
+    int counts[MACHINE_HALTED + 1] = {0};
+    uint64_t min_cycles = UINT64_MAX, max_cycles = 0, total_cycles = 0;
+    uint64_t quanta = 0, wait_total = 0, wait_max = 0;
+    double sum = 0, sum_squares = 0;
+    int live = 0;
+
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < machine_count; i++) {
+        const Machine *machine = machines[i];
+        uint64_t cycles = machine->cpu.cycles;
+        counts[machine->state]++;
+        total_cycles += cycles;
+        if (cycles < min_cycles) min_cycles = cycles;
+        if (cycles > max_cycles) max_cycles = cycles;
+        quanta += machine->quanta;
+        wait_total += machine->wait_ns_total;
+        if (machine->wait_ns_max > wait_max)
+            wait_max = machine->wait_ns_max;
+        if (machine->state != MACHINE_HALTED) {
+            sum += (double)cycles;
+            sum_squares += (double)cycles * cycles;
+            live++;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (machine_count == 0)
+        return;
+    printf("Machines: %d (%d ready, %d running, %d parked, %d halted) on %d threads\n",
+           machine_count, counts[MACHINE_READY], counts[MACHINE_RUNNING],
+           counts[MACHINE_PARKED], counts[MACHINE_HALTED], worker_count);
+    printf("Cycles per machine: min %llu, max %llu, mean %llu\n",
+           (unsigned long long)min_cycles, (unsigned long long)max_cycles,
+           (unsigned long long)(total_cycles / machine_count));
+    if (live > 0 && sum_squares > 0)
+        printf("Fairness (live machines): %.4f\n", sum * sum / (live * sum_squares));
+    printf("Quanta: %llu, run queue wait: mean %.1f us, max %.1f us\n",
+           (unsigned long long)quanta, quanta ? wait_total / 1000.0 / quanta : 0.0,
+           wait_max / 1000.0);
+}
+
+static const char *state_names[] = { "ready", "running", "parked", "halted" };
+
+// One line per machine: id, state, cycles, quanta, parks, wakes and the
+// mean/max run queue wait in microseconds
+int scheduler_write_stats(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Error: Unable to write machine statistics to %s\n", filename);
+        return -1;
+    }
+
+    pthread_mutex_lock(&lock);
+    fprintf(file, "# id state cycles quanta parks wakes wait_mean_us wait_max_us\n");
+    for (int i = 0; i < machine_count; i++) {
+        const Machine *machine = machines[i];
+        fprintf(file, "%d %s %llu %llu %llu %llu %.1f %.1f\n", machine->id,
+                state_names[machine->state], (unsigned long long)machine->cpu.cycles,
+                (unsigned long long)machine->quanta, (unsigned long long)machine->parks,
+                (unsigned long long)machine->wakes,
+                machine->quanta ? machine->wait_ns_total / 1000.0 / machine->quanta : 0.0,
+                machine->wait_ns_max / 1000.0);
+    }
+    pthread_mutex_unlock(&lock);
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "machine.h"
+
+// M:N scheduler: many machines multiplexed over a fixed pool of worker
+// threads. A worker takes the machine at the head of the run queue, runs
+// it for one quantum of cycles and puts it back at the tail. Machines that
+// spin on an idle loop (an instruction that jumps to itself) or that device
+// code parks with scheduler_park_current() leave the queue until
+// scheduler_wake() is called for them, from any thread.
+
+#define SCHEDULER_DEFAULT_QUANTUM 10000   // Cycles per turn
+#define SCHEDULER_MAX_THREADS 256
+
+int scheduler_start(int threads, uint64_t quantum);
+int scheduler_add(Machine *machine);
+void scheduler_wake(Machine *machine);
+void scheduler_park_current(void);
+Machine *scheduler_current_machine(void);
+void scheduler_wait(void);
+void scheduler_wait_halted(void);
+void scheduler_shutdown(void);
+void scheduler_print_stats(void);
+int scheduler_write_stats(const char *filename);
+
+#endif
@@ -0,0 +1,472 @@
+#define _XOPEN_SOURCE 700
+#include "serial.h"
+#include "scheduler.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERIAL_QUEUE_MASK  (SERIAL_QUEUE_SIZE - 1)
+#define SERIAL_IDLE_POLLS  64      // Spinning empty status reads in a row before parking
+#define SERIAL_SPIN_CYCLES 16      // Longest status poll loop counted as a spin
+#define SERIAL_PARK_MS     10      // Parked guests are rewoken at least this often
+#define SERIAL_WAKE_ID     UINT64_MAX
+
+static SerialPort *ports[SERIAL_MAX_PORTS];
+static int port_count = 0;
+static int epoll_fd = -1;
+static int wake_fd = -1;
+static pthread_t loop_thread;
+static int loop_running = 0;
+static atomic_int stopping;
+static atomic_ullong loop_wakeups;
+static SerialPort *_Atomic ready_ports;   // Ports the loop must serve
+static int machine_ports = 0;             // Ports whose guest may park
+
+static uint32_t queue_used(SerialQueue *queue) {
+    return atomic_load_explicit(&queue->tail, memory_order_acquire) -
+           atomic_load_explicit(&queue->head, memory_order_acquire);
+}
+
+static void signal_loop(void) {
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("serial wake");
+}
+
+// Pushes <port> on the ready list, once until the loop takes it off; the
+// loop is only signalled by the push that finds the list empty
+static void mark_ready(SerialPort *port) {
+    if (atomic_exchange(&port->ready, 1))
+        return;
+    SerialPort *next = atomic_load(&ready_ports);
+    do {
+        atomic_store_explicit(&port->ready_next, next, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak(&ready_ports, &next, port));
+    if (next == NULL)
+        signal_loop();
+}
+
+// Guest side -----------------------------------------------------------
+
+// An empty status read is part of a spin when it comes from the same PC
+// with the same registers within a few cycles of the previous one. A poll
+// loop that also counts, or does other work between polls, never parks.
+static int spinning(SerialPort *port, const CPU *cpu) {
+    uint8_t registers[5] = { cpu->A, cpu->X, cpu->Y, cpu->SP, cpu->status };
+    int spin = cpu->PC == port->poll_pc &&
+               cpu->cycles - port->poll_cycles <= SERIAL_SPIN_CYCLES &&
+               memcmp(registers, port->poll_registers, sizeof(registers)) == 0;
+    port->poll_pc = cpu->PC;
+    port->poll_cycles = cpu->cycles;
+    memcpy(port->poll_registers, registers, sizeof(registers));
+    return spin;
+}
+
+static uint8_t serial_read(void *context, uint16_t address) {
+    SerialPort *port = context;
+
+    switch ((address - port->base) % SERIAL_REGISTER_COUNT) {
+        case SERIAL_DATA: {
+            port->empty_polls = 0;
+            uint32_t head = atomic_load_explicit(&port->rx.head, memory_order_relaxed);
+            if (head == atomic_load_explicit(&port->rx.tail, memory_order_acquire))
+                return 0;
+            uint8_t value = port->rx.data[head & SERIAL_QUEUE_MASK];
+            atomic_store_explicit(&port->rx.head, head + 1, memory_order_release);
+            // The loop stopped reading when the ring filled; let it resume
+            if (atomic_load(&port->rx_blocked) && atomic_exchange(&port->rx_blocked, 0))
+                mark_ready(port);
+            return value;
+        }
+        case SERIAL_STATUS: {
+            uint8_t status = 0;
+            if (queue_used(&port->rx) > 0)
+                status |= SERIAL_STATUS_RX_FULL;
+            if (queue_used(&port->tx) < SERIAL_QUEUE_SIZE)
+                status |= SERIAL_STATUS_TX_EMPTY;
+            if (port->overrun)
+                status |= SERIAL_STATUS_OVERRUN;
+            if (!atomic_load_explicit(&port->connected, memory_order_relaxed))
+                status |= SERIAL_STATUS_NO_CARRIER;
+            port->overrun = 0;
+
+            // A guest spinning on an empty receiver sleeps until the loop
+            // delivers bytes, drains its transmitter or the park times out.
+            // Rechecking after the flag is set catches a loop that moved
+            // bytes just before.
+            if ((status & SERIAL_STATUS_RX_FULL) || !port->machine ||
+                !spinning(port, &port->machine->cpu)) {
+                port->empty_polls = 0;
+            } else if (++port->empty_polls >= SERIAL_IDLE_POLLS) {
+                port->empty_polls = 0;
+                atomic_store(&port->parked, 1);
+                scheduler_park_current();
+                if ((queue_used(&port->rx) > 0 ||
+                     (!(status & SERIAL_STATUS_TX_EMPTY) && queue_used(&port->tx) < SERIAL_QUEUE_SIZE)) &&
+                    atomic_exchange(&port->parked, 0))
+                    scheduler_wake(port->machine);
+            }
+            return status;
+        }
+        case SERIAL_COMMAND:
+            return port->command;
+        default:
+            return port->control;
+    }
+}
+
+static void serial_write(void *context, uint16_t address, uint8_t value) {
+    SerialPort *port = context;
+
+    switch ((address - port->base) % SERIAL_REGISTER_COUNT) {
+        case SERIAL_DATA: {
+            port->empty_polls = 0;
+            uint32_t tail = atomic_load_explicit(&port->tx.tail, memory_order_relaxed);
+            if (tail - atomic_load_explicit(&port->tx.head, memory_order_acquire) == SERIAL_QUEUE_SIZE) {
+                port->overrun = 1;
+                atomic_fetch_add_explicit(&port->dropped, 1, memory_order_relaxed);
+                return;
+            }
+            port->tx.data[tail & SERIAL_QUEUE_MASK] = value;
+            atomic_store_explicit(&port->tx.tail, tail + 1, memory_order_release);
+            // One wakeup per drain, however many bytes follow it
+            if (!atomic_load(&port->tx_signalled) && !atomic_exchange(&port->tx_signalled, 1))
+                mark_ready(port);
+            break;
+        }
+        case SERIAL_COMMAND:
+            port->command = value;
+            break;
+        case SERIAL_CONTROL:
+            port->control = value;
+            break;
+    }
+}
+
+// Event loop side --------------------------------------------------------
+
+static void set_events(SerialPort *port, uint32_t events) {
+    if (port->fd < 0 || events == port->events)
+        return;
+    struct epoll_event event = { .events = events, .data.u64 = (uint64_t)port->index * 2 };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, port->fd, &event) == 0)
+        port->events = events;
+}
+
+static void wake_guest(SerialPort *port) {
+    if (port->machine && atomic_load(&port->parked) && atomic_exchange(&port->parked, 0))
+        scheduler_wake(port->machine);
+}
+
+static void disconnect(SerialPort *port) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, port->fd, NULL);
+    close(port->fd);
+    port->fd = -1;
+    port->events = 0;
+    atomic_store(&port->connected, 0);
+}
+
+static void flush_tx(SerialPort *port) {
+    uint32_t moved = 0;
+
+    while (port->fd >= 0) {
+        uint32_t head = atomic_load_explicit(&port->tx.head, memory_order_relaxed);
+        uint32_t used = atomic_load_explicit(&port->tx.tail, memory_order_acquire) - head;
+        if (used == 0)
+            break;
+        uint32_t offset = head & SERIAL_QUEUE_MASK;
+        uint32_t chunk = used < SERIAL_QUEUE_SIZE - offset ? used : SERIAL_QUEUE_SIZE - offset;
+        ssize_t written = write(port->fd, port->tx.data + offset, chunk);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            if (port->listen_fd >= 0)
+                disconnect(port);
+            break;
+        }
+        atomic_store_explicit(&port->tx.head, head + written, memory_order_release);
+        atomic_fetch_add_explicit(&port->tx_bytes, written, memory_order_relaxed);
+        moved += written;
+    }
+    // Ask for EPOLLOUT only while bytes are waiting on the host
+    uint32_t events = port->events & ~EPOLLOUT;
+    if (port->fd >= 0 && queue_used(&port->tx) > 0)
+        events |= EPOLLOUT;
+    set_events(port, events);
+    if (moved)
+        wake_guest(port);
+}
+
+static void fill_rx(SerialPort *port) {
+    uint32_t moved = 0;
+
+    while (port->fd >= 0) {
+        uint32_t tail = atomic_load_explicit(&port->rx.tail, memory_order_relaxed);
+        uint32_t space = SERIAL_QUEUE_SIZE - (tail - atomic_load_explicit(&port->rx.head, memory_order_acquire));
+        if (space == 0) {
+            // Stop reading until the guest makes room, rechecking after the
+            // flag is visible so a concurrent read is not missed
+            atomic_store(&port->rx_blocked, 1);
+            if (tail - atomic_load(&port->rx.head) < SERIAL_QUEUE_SIZE &&
+                atomic_exchange(&port->rx_blocked, 0))
+                continue;
+            set_events(port, port->events & ~EPOLLIN);
+            break;
+        }
+        uint32_t offset = tail & SERIAL_QUEUE_MASK;
+        uint32_t chunk = space < SERIAL_QUEUE_SIZE - offset ? space : SERIAL_QUEUE_SIZE - offset;
+        ssize_t count = read(port->fd, port->rx.data + offset, chunk);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0) {
+            if ((count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) && port->listen_fd >= 0)
+                disconnect(port);
+            break;
+        }
+        atomic_store_explicit(&port->rx.tail, tail + count, memory_order_release);
+        atomic_fetch_add_explicit(&port->rx_bytes, count, memory_order_relaxed);
+        moved += count;
+    }
+    if (moved)
+        wake_guest(port);
+}
+
+static void accept_client(SerialPort *port) {
+    int fd = accept(port->listen_fd, NULL, NULL);
+    if (fd < 0)
+        return;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (port->fd >= 0) {            // One client at a time
+        close(fd);
+        return;
+    }
+    port->fd = fd;
+    port->events = EPOLLIN;
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = (uint64_t)port->index * 2 };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    atomic_store(&port->connected, 1);
+    flush_tx(port);
+}
+
+static uint64_t now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void *loop_main(void *argument) {
+    (void)argument;
+    struct epoll_event events[64];
+    uint64_t next_rewake = now_ms() + SERIAL_PARK_MS;
+
+    while (!atomic_load(&stopping)) {
+        // With guests that can park, wake at least every SERIAL_PARK_MS to
+        // bound each park; a spinning guest simply parks again
+        int count = epoll_wait(epoll_fd, events, 64, machine_ports ? SERIAL_PARK_MS : -1);
+        if (count < 0 && errno != EINTR)
+            break;
+        if (machine_ports && now_ms() >= next_rewake) {
+            for (int p = 0; p < port_count; p++)
+                wake_guest(ports[p]);
+            next_rewake = now_ms() + SERIAL_PARK_MS;
+        }
+        for (int i = 0; i < count; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == SERIAL_WAKE_ID) {
+                uint64_t value;
+                if (read(wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                    perror("serial wake");
+                atomic_fetch_add_explicit(&loop_wakeups, 1, memory_order_relaxed);
+                SerialPort *next;
+                for (SerialPort *port = atomic_exchange(&ready_ports, NULL); port; port = next) {
+                    next = atomic_load_explicit(&port->ready_next, memory_order_relaxed);
+                    // Cleared first so a request made while serving re-queues
+                    atomic_store(&port->ready, 0);
+                    atomic_store(&port->tx_signalled, 0);
+                    flush_tx(port);
+                    if (port->fd >= 0 && !(port->events & EPOLLIN) && !atomic_load(&port->rx_blocked)) {
+                        set_events(port, port->events | EPOLLIN);
+                        fill_rx(port);
+                    }
+                }
+                continue;
+            }
+            SerialPort *port = ports[id / 2];
+            if (id & 1) {
+                accept_client(port);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                fill_rx(port);
+            if (port->fd >= 0 && (events[i].events & EPOLLOUT))
+                flush_tx(port);
+        }
+    }
+    // Hand over whatever the guests wrote last
+    for (int p = 0; p < port_count; p++)
+        flush_tx(ports[p]);
+    return NULL;
+}
+
+static int open_pty(SerialPort *port) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        printf("Error: Unable to open a PTY for serial port %d\n", port->index);
+        if (master >= 0)
+            close(master);
+        return -1;
+    }
+    snprintf(port->path, sizeof(port->path), "%s", ptsname(master));
+    port->pty_slave = open(port->path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (port->pty_slave >= 0) {
+        struct termios settings;
+        if (tcgetattr(port->pty_slave, &settings) == 0) {
+            // Raw mode: bytes pass through unchanged, without echo
+            settings.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+            settings.c_oflag &= ~OPOST;
+            settings.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+            settings.c_cflag &= ~(CSIZE | PARENB);
+            settings.c_cflag |= CS8;
+            tcsetattr(port->pty_slave, TCSANOW, &settings);
+        }
+    }
+    port->fd = master;
+    port->events = EPOLLIN;
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = (uint64_t)port->index * 2 };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, master, &event);
+    atomic_store(&port->connected, 1);
+    return 0;
+}
+
+static int open_socket(SerialPort *port, const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Error: Serial socket path %s is too long\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    snprintf(port->path, sizeof(port->path), "%s", path);
+
+    port->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (port->listen_fd < 0 || fcntl(port->listen_fd, F_SETFL, O_NONBLOCK) < 0 ||
+        bind(port->listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(port->listen_fd, 1) < 0) {
+        printf("Error: Unable to listen on serial socket %s\n", path);
+        return -1;
+    }
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = (uint64_t)port->index * 2 + 1 };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, port->listen_fd, &event);
+    return 0;
+}
+
+SerialPort *serial_attach(uint16_t base, const char *target, Machine *machine) {
+    if (port_count == SERIAL_MAX_PORTS) {
+        printf("Error: Too many serial ports\n");
+        return NULL;
+    }
+    if (epoll_fd < 0) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event event = { .events = EPOLLIN, .data.u64 = SERIAL_WAKE_ID };
+        if (epoll_fd < 0 || wake_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) < 0) {
+            printf("Error: Unable to create the serial event loop\n");
+            return NULL;
+        }
+    }
+
+    SerialPort *port = calloc(1, sizeof(SerialPort));
+    if (port == NULL) {
+        printf("Error: Out of memory creating serial port\n");
+        return NULL;
+    }
+    port->index = port_count;
+    port->base = base;
+    port->machine = machine;
+    port->fd = -1;
+    port->listen_fd = -1;
+    port->pty_slave = -1;
+
+    int opened;
+    if (strcmp(target, "pty") == 0) {
+        opened = open_pty(port);
+    } else if (strncmp(target, "unix:", 5) == 0) {
+        opened = open_socket(port, target + 5);
+    } else {
+        printf("Error: Unknown serial target %s (use pty or unix:<path>)\n", target);
+        opened = -1;
+    }
+    IoDevice device = { base, base + SERIAL_REGISTER_COUNT - 1, serial_read, serial_write, port };
+    if (opened < 0 || register_io_device(&device) < 0) {
+        if (port->fd >= 0)
+            close(port->fd);
+        if (port->listen_fd >= 0)
+            close(port->listen_fd);
+        if (port->pty_slave >= 0)
+            close(port->pty_slave);
+        free(port);
+        return NULL;
+    }
+    ports[port_count++] = port;
+    if (machine)
+        machine_ports++;
+    printf("Serial port %d: %s\n", port->index, port->path);
+    fflush(stdout);                 // Host tooling waits for the path
+    return port;
+}
+
+int serial_start(void) {
+    if (port_count == 0 || loop_running)
+        return 0;
+    atomic_store(&stopping, 0);
+    if (pthread_create(&loop_thread, NULL, loop_main, NULL) != 0) {
+        printf("Error: Unable to start the serial event loop\n");
+        return -1;
+    }
+    loop_running = 1;
+    return 0;
+}
+
+void serial_shutdown(void) {
+    if (loop_running) {
+        atomic_store(&stopping, 1);
+        signal_loop();
+        pthread_join(loop_thread, NULL);
+        loop_running = 0;
+    }
+    for (int i = 0; i < port_count; i++) {
+        SerialPort *port = ports[i];
+        if (port->fd >= 0)
+            close(port->fd);
+        if (port->pty_slave >= 0)
+            close(port->pty_slave);
+        if (port->listen_fd >= 0) {
+            close(port->listen_fd);
+            unlink(port->path);
+        }
+    }
+}
+
+void serial_print_stats(void) {
+    unsigned long long rx = 0, tx = 0, dropped = 0;
+    for (int i = 0; i < port_count; i++) {
+        rx += atomic_load(&ports[i]->rx_bytes);
+        tx += atomic_load(&ports[i]->tx_bytes);
+        dropped += atomic_load(&ports[i]->dropped);
+    }
+    printf("Serial: %d ports, %llu bytes received, %llu sent, %llu dropped, %llu loop wakeups\n",
+           port_count, rx, tx, dropped, (unsigned long long)atomic_load(&loop_wakeups));
+}
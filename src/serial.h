@@ -0,0 +1,84 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "machine.h"
+#include <stdatomic.h>
+
+// ACIA-style serial port (6551 register layout) bridged to a host PTY or
+// Unix socket.
+//
+// One event-loop thread serves the host side of every port in the process
+// with epoll. Guest and host exchange bytes through two single-producer,
+// single-consumer rings per port, so the CPU thread never takes a lock or
+// makes a system call per byte. When a port's transmit ring needs draining
+// or its receive ring frees up after filling, the guest pushes the port on
+// a lock-free ready list and writes the loop's eventfd only if the list
+// was empty; the loop then serves just the listed ports. A guest on the
+// scheduler that spins on the status of an empty receiver is parked and
+// woken when bytes arrive, or after SERIAL_PARK_MS in any case, so a poll
+// the CPU state cannot show to be a pure spin still makes progress.
+
+#define SERIAL_DEFAULT_BASE    0x2500
+#define SERIAL_DATA            0x00   // Read: receive; write: transmit
+#define SERIAL_STATUS          0x01
+#define SERIAL_COMMAND         0x02   // Stored only
+#define SERIAL_CONTROL         0x03   // Stored only
+#define SERIAL_REGISTER_COUNT  0x04
+
+#define SERIAL_STATUS_OVERRUN     0x04   // A transmitted byte was dropped
+#define SERIAL_STATUS_RX_FULL     0x08   // Receive data available
+#define SERIAL_STATUS_TX_EMPTY    0x10   // Room to transmit
+#define SERIAL_STATUS_NO_CARRIER  0x20   // No client on a socket port
+
+#define SERIAL_QUEUE_SIZE      4096   // Power of two
+#define SERIAL_MAX_PORTS       1024
+
+typedef struct {
+    _Atomic uint32_t head;      // Consumer
+    _Atomic uint32_t tail;      // Producer
+    uint8_t data[SERIAL_QUEUE_SIZE];
+} SerialQueue;
+
+typedef struct SerialPort {
+    int index;
+    uint16_t base;
+    Machine *machine;           // Woken on receive; NULL outside the scheduler
+    uint8_t command;
+    uint8_t control;
+    uint8_t overrun;
+    int empty_polls;            // Spinning status reads in a row with nothing received
+    // CPU state at the last empty status read; a poll only counts as
+    // spinning when it repeats this from the same PC a few cycles later
+    uint16_t poll_pc;
+    uint8_t poll_registers[5];  // A, X, Y, SP, status
+    uint64_t poll_cycles;
+
+    SerialQueue rx;             // Host to guest
+    SerialQueue tx;             // Guest to host
+    atomic_int tx_signalled;    // Loop already told to drain tx
+    atomic_int rx_blocked;      // Loop stopped reading; rx was full
+    atomic_int connected;
+    atomic_int parked;          // Guest parked waiting on this port
+    atomic_int ready;           // On the loop's ready list
+    struct SerialPort *_Atomic ready_next;
+
+    // Event loop side
+    int fd;                     // PTY master or socket client, -1 if none
+    int listen_fd;              // Socket ports
+    int pty_slave;              // Held open so the master never sees a hangup
+    char path[108];
+    uint32_t events;
+
+    atomic_ullong rx_bytes;
+    atomic_ullong tx_bytes;
+    atomic_ullong dropped;
+} SerialPort;
+
+// <target> is "pty" or "unix:<path>". Registers the port on the current
+// bus; ports must all be attached before serial_start().
+SerialPort *serial_attach(uint16_t base, const char *target, Machine *machine);
+int serial_start(void);
+void serial_shutdown(void);
+void serial_print_stats(void);
+
+#endif
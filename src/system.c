@@ -0,0 +1,291 @@
+#define _POSIX_C_SOURCE 200809L
+#include "system.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define PAGE_SHARED 0xFF
+#define PAGE_LOCAL  0xFE
+
+typedef struct {
+    int index;
+    CPU cpu;
+    Bus view;
+    uint8_t *local_pages[RAM_PAGE_COUNT];
+    uint64_t instruction_cycles;    // Cycle count when the current instruction started
+    _Atomic uint64_t progress;      // Published at instruction boundaries; UINT64_MAX when done
+    uint64_t shared_accesses;
+    uint64_t waits;
+    uint64_t faults;                // Accesses to pages another CPU owns
+} SystemCpu;
+
+static SystemCpu cpus[SYSTEM_MAX_CPUS];
+static int cpu_count = 0;
+static ExecuteFunction cpu_step = NULL;
+static uint8_t page_owner[RAM_PAGE_COUNT];  // PAGE_SHARED, PAGE_LOCAL or a CPU index
+static uint64_t slice_cycles = SYSTEM_DEFAULT_GRANULARITY;
+static int parallel_run = 0;
+
+// Index of the physical RAM page behind <page>, or -1 outside RAM
+static int ram_page(int page) {
+    return page <= (MIRRORED_RAM_END >> 8) ? page % RAM_PAGE_COUNT : -1;
+}
+
+// Blocks until every shared access ahead of this one in the strict order
+// has happened. CPUs before this one must have finished the slice, the
+// ones after it the previous slice.
+static void wait_turn(SystemCpu *self) {
+    if (!parallel_run)
+        return;
+    uint64_t slice = self->instruction_cycles / slice_cycles;
+    for (int i = 0; i < cpu_count; i++) {
+        if (i == self->index)
+            continue;
+        uint64_t needed = (i < self->index ? slice + 1 : slice) * slice_cycles;
+        if (atomic_load_explicit(&cpus[i].progress, memory_order_acquire) >= needed)
+            continue;
+        self->waits++;
+        while (atomic_load_explicit(&cpus[i].progress, memory_order_acquire) < needed)
+            sched_yield();
+    }
+}
+
+static int foreign_page(SystemCpu *self, uint16_t address) {
+    int index = ram_page(address >> 8);
+    return index >= 0 && page_owner[index] != PAGE_SHARED && page_owner[index] != PAGE_LOCAL &&
+           page_owner[index] != self->index;
+}
+
+static uint8_t view_miss_read(void *context, uint16_t address) {
+    SystemCpu *self = context;
+    if (foreign_page(self, address)) {
+        self->faults++;
+        return 0xFF;
+    }
+    wait_turn(self);
+    self->shared_accesses++;
+    current_bus = &default_bus;
+    uint8_t value = read_memory(address);
+    current_bus = &self->view;
+    return value;
+}
+
+static void view_miss_write(void *context, uint16_t address, uint8_t value) {
+    SystemCpu *self = context;
+    if (foreign_page(self, address)) {
+        self->faults++;
+        return;
+    }
+    wait_turn(self);
+    self->shared_accesses++;
+    current_bus = &default_bus;
+    write_memory(address, value);
+    current_bus = &self->view;
+}
+
+// Rebuilds every CPU's view from the page ownership
+static int build_views(void) {
+    for (int c = 0; c < cpu_count; c++) {
+        SystemCpu *self = &cpus[c];
+        Bus *view = &self->view;
+        memset(view, 0, sizeof(*view));
+        view->miss_read = view_miss_read;
+        view->miss_write = view_miss_write;
+        view->miss_context = self;
+
+        for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+            int index = ram_page(page);
+            if (index < 0) { // ROM reads are safe to share; writes go through the miss path
+                view->read_pages[page] = default_bus.read_pages[page];
+                continue;
+            }
+            uint8_t owner = page_owner[index];
+            if (owner == PAGE_LOCAL) {
+                if (self->local_pages[index] == NULL) {
+                    self->local_pages[index] = malloc(MEMORY_PAGE_SIZE);
+                    if (self->local_pages[index] == NULL) {
+                        printf("Error: Out of memory for local RAM\n");
+                        return -1;
+                    }
+                    memcpy(self->local_pages[index], default_bus.read_pages[index],
+                           MEMORY_PAGE_SIZE);
+                }
+                view->read_pages[page] = view->write_pages[page] = self->local_pages[index];
+            } else if (owner == c) {
+                view->read_pages[page] = default_bus.read_pages[page];
+                view->write_pages[page] = default_bus.write_pages[page];
+            }
+        }
+    }
+    return 0;
+}
+
+// <cpu_count> CPUs over the default bus, all starting at <start>. Zero
+// page and stack are local by default.
+int system_init(int count, uint16_t start, ExecuteFunction step) {
+    if (count < 1 || count > SYSTEM_MAX_CPUS) {
+        printf("Error: A system has 1-%d CPUs\n", SYSTEM_MAX_CPUS);
+        return -1;
+    }
+    if (mapper_active()) {
+        printf("Error: Multi-CPU systems do not support mappers\n");
+        return -1;
+    }
+    cpu_count = count;
+    cpu_step = step ? step : execute;
+    memset(page_owner, PAGE_SHARED, sizeof(page_owner));
+    page_owner[0x00] = page_owner[0x01] = PAGE_LOCAL;
+    for (int c = 0; c < count; c++) {
+        memset(&cpus[c], 0, sizeof(SystemCpu));
+        cpus[c].index = c;
+        reset_cpu(&cpus[c].cpu);
+        cpus[c].cpu.PC = start;
+        cpus[c].cpu.X = c;
+    }
+    return build_views();
+}
+
+static int parse_range(const char *text, int *first, int *last) {
+    unsigned int low, high;
+    if (sscanf(text, "%x-%x", &low, &high) != 2 || low > high || high > MIRRORED_RAM_END)
+        return -1;
+    *first = ram_page(low >> 8);
+    *last = ram_page(high >> 8);
+    return *first <= *last ? 0 : -1;
+}
+
+// Lines of "local <lo>-<hi>", "shared <lo>-<hi>", "own <cpu> <lo>-<hi>" and
+// "start <cpu> <address>", in hex. Ranges cover whole RAM pages.
+int system_load_config(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error: Unable to open system file %s\n", filename);
+        return -1;
+    }
+
+    char line[128], keyword[16], range[32];
+    int line_number = 0, cpu, first, last, error = 0;
+    unsigned int address;
+    while (!error && fgets(line, sizeof(line), file)) {
+        line_number++;
+        if (line[0] == '#' || sscanf(line, "%15s", keyword) != 1)
+            continue;
+        if (strcmp(keyword, "local") == 0 && sscanf(line, "%*s %31s", range) == 1 &&
+            parse_range(range, &first, &last) == 0) {
+            memset(&page_owner[first], PAGE_LOCAL, last - first + 1);
+        } else if (strcmp(keyword, "shared") == 0 && sscanf(line, "%*s %31s", range) == 1 &&
+                   parse_range(range, &first, &last) == 0) {
+            memset(&page_owner[first], PAGE_SHARED, last - first + 1);
+        } else if (strcmp(keyword, "own") == 0 && sscanf(line, "%*s %d %31s", &cpu, range) == 2 &&
+                   cpu >= 0 && cpu < cpu_count && parse_range(range, &first, &last) == 0) {
+            memset(&page_owner[first], cpu, last - first + 1);
+        } else if (strcmp(keyword, "start") == 0 &&
+                   sscanf(line, "%*s %d %x", &cpu, &address) == 2 && cpu >= 0 &&
+                   cpu < cpu_count && address <= 0xFFFF) {
+            cpus[cpu].cpu.PC = address;
+        } else {
+            printf("Error: %s:%d: bad system line\n", filename, line_number);
+            error = 1;
+        }
+    }
+    fclose(file);
+    return error ? -1 : build_views();
+}
+
+static int should_run(const SystemCpu *self, uint64_t max_cycles) {
+    return self->cpu.is_running && (max_cycles == 0 || self->cpu.cycles < max_cycles);
+}
+
+static void step_cpu(SystemCpu *self) {
+    self->instruction_cycles = self->cpu.cycles;
+    cpu_step(&self->cpu, NULL);
+}
+
+typedef struct {
+    SystemCpu *self;
+    uint64_t max_cycles;
+} CpuThread;
+
+static void *cpu_thread(void *arg) {
+    CpuThread *thread = arg;
+    SystemCpu *self = thread->self;
+
+    current_bus = &self->view;
+    while (should_run(self, thread->max_cycles)) {
+        step_cpu(self);
+        atomic_store_explicit(&self->progress, self->cpu.cycles, memory_order_release);
+    }
+    atomic_store_explicit(&self->progress, UINT64_MAX, memory_order_release);
+    current_bus = &default_bus;
+    return NULL;
+}
+
+// Runs until every CPU halts or reaches <max_cycles> (0: no limit), either
+// strictly interleaved on this thread or with a thread per CPU
+void system_run(int parallel, uint64_t granularity, uint64_t max_cycles) {
+    slice_cycles = granularity ? granularity : SYSTEM_DEFAULT_GRANULARITY;
+    parallel_run = parallel && cpu_count > 1;
+    for (int c = 0; c < cpu_count; c++)
+        atomic_store(&cpus[c].progress, cpus[c].cpu.cycles);
+
+    if (parallel_run) {
+        pthread_t threads[SYSTEM_MAX_CPUS];
+        CpuThread args[SYSTEM_MAX_CPUS];
+        for (int c = 0; c < cpu_count; c++) {
+            args[c] = (CpuThread){ &cpus[c], max_cycles };
+            if (c > 0 && pthread_create(&threads[c], NULL, cpu_thread, &args[c]) != 0) {
+                // The started CPUs would wait forever on this one
+                printf("Error: Unable to start CPU thread %d\n", c);
+                exit(1);
+            }
+        }
+        cpu_thread(&args[0]);
+        for (int c = 1; c < cpu_count; c++)
+            pthread_join(threads[c], NULL);
+        return;
+    }
+
+    Bus *saved = current_bus;
+    for (uint64_t slice = 1;; slice++) {
+        int running = 0;
+        for (int c = 0; c < cpu_count; c++) {
+            SystemCpu *self = &cpus[c];
+            current_bus = &self->view;
+            while (should_run(self, max_cycles) && self->cpu.cycles < slice * slice_cycles)
+                step_cpu(self);
+            running += should_run(self, max_cycles);
+        }
+        if (running == 0)
+            break;
+    }
+    current_bus = saved;
+}
+
+const CPU *system_cpu(int index) {
+    return index >= 0 && index < cpu_count ? &cpus[index].cpu : NULL;
+}
+
+void system_print_stats(void) {
+    printf("System: %d CPUs, %llu-cycle slices, %s\n", cpu_count,
+           (unsigned long long)slice_cycles, parallel_run ? "parallel" : "strict");
+    for (int c = 0; c < cpu_count; c++) {
+        const SystemCpu *self = &cpus[c];
+        printf("CPU %d: A=%02X X=%02X Y=%02X P=%02X PC=%04X SP=%02X, %llu cycles, "
+               "%llu shared accesses, %llu waits, %llu faults\n",
+               c, self->cpu.A, self->cpu.X, self->cpu.Y, self->cpu.status, self->cpu.PC,
+               self->cpu.SP, (unsigned long long)self->cpu.cycles,
+               (unsigned long long)self->shared_accesses, (unsigned long long)self->waits,
+               (unsigned long long)self->faults);
+    }
+}
+
+void system_free(void) {
+    for (int c = 0; c < cpu_count; c++) {
+        for (int i = 0; i < RAM_PAGE_COUNT; i++) {
+            free(cpus[c].local_pages[i]);
+            cpus[c].local_pages[i] = NULL;
+        }
+    }
+    cpu_count = 0;
+}
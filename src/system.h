@@ -0,0 +1,35 @@
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+#include "cpu.h"
+#include "memory.h"
+#include "variants.h"
+
+// Several CPUs sharing one bus (the default bus).
+//
+// The reference order is strict interleaving: in every slice of
+// <granularity> cycles, CPU 0 runs until its cycle count reaches the end
+// of the slice, then CPU 1, and so on. An instruction belongs to the slice
+// its starting cycle count falls in.
+//
+// Each internal RAM page (mirrors included) is one of:
+//   local   every CPU has its own copy, initialized from the shared bus
+//   owned   one CPU's; other CPUs read $FF there and their writes are lost
+//   shared  everything else
+// In parallel mode every CPU runs on its own thread. Local, owned and ROM
+// pages are mapped into each CPU's view directly. Shared RAM and I/O miss
+// the view and wait until every access earlier in the reference order
+// has happened, so the result matches a strict run. CPU n starts with
+// X = n. Mappers are not supported.
+
+#define SYSTEM_MAX_CPUS 8
+#define SYSTEM_DEFAULT_GRANULARITY 100
+
+int system_init(int cpu_count, uint16_t start, ExecuteFunction step);
+int system_load_config(const char *filename);
+void system_run(int parallel, uint64_t granularity, uint64_t max_cycles);
+const CPU *system_cpu(int index);
+void system_print_stats(void);
+void system_free(void);
+
+#endif
@@ -0,0 +1,89 @@
+#include "variants.h"
+#include "memory.h"
+#include "busstats.h"
+#include "metrics.h"
+#include "opcodes.h"
+#include <string.h>
+
+#if CPU_VARIANTS & CPU_VARIANT_NMOS
+#define VARIANT_NAME nmos
+#define VARIANT_OPCODES (OPS_OFFICIAL | OPS_ILLEGAL)
+#define VARIANT_DECIMAL 1
+#include "interpreter.inc"
+
+#define VARIANT_NAME nmos_nodecimal
+#define VARIANT_OPCODES (OPS_OFFICIAL | OPS_ILLEGAL)
+#define VARIANT_DECIMAL 0
+#include "interpreter.inc"
+#endif
+
+#if CPU_VARIANTS & CPU_VARIANT_NMOS_DOCUMENTED
+#define VARIANT_NAME nmos_documented
+#define VARIANT_OPCODES OPS_OFFICIAL
+#define VARIANT_DECIMAL 1
+#include "interpreter.inc"
+
+#define VARIANT_NAME nmos_documented_nodecimal
+#define VARIANT_OPCODES OPS_OFFICIAL
+#define VARIANT_DECIMAL 0
+#include "interpreter.inc"
+#endif
+
+#if CPU_VARIANTS & CPU_VARIANT_65C02
+#define VARIANT_NAME 65c02
+#define VARIANT_OPCODES (OPS_OFFICIAL | OPS_65C02)
+#define VARIANT_DECIMAL 2
+#include "interpreter.inc"
+
+#define VARIANT_NAME 65c02_nodecimal
+#define VARIANT_OPCODES (OPS_OFFICIAL | OPS_65C02)
+#define VARIANT_DECIMAL 0
+#include "interpreter.inc"
+#endif
+
+#if CPU_VARIANTS & CPU_VARIANT_LEGACY
+static void run_legacy(CPU *cpu, uint8_t *memory) {
+    while (cpu->is_running) {
+        execute(cpu, memory);
+    }
+}
+#endif
+
+const CpuVariant cpu_variants[] = {
+#if CPU_VARIANTS & CPU_VARIANT_NMOS
+    { "nmos",                        "NMOS 6502 with unofficial opcodes",     execute_nmos, run_nmos,
+      OPS_OFFICIAL | OPS_ILLEGAL },
+    { "nmos-nodecimal",              "NMOS 6502, decimal mode disabled",      execute_nmos_nodecimal, run_nmos_nodecimal,
+      OPS_OFFICIAL | OPS_ILLEGAL },
+#endif
+#if CPU_VARIANTS & CPU_VARIANT_NMOS_DOCUMENTED
+    { "nmos-documented",             "NMOS 6502, documented opcodes only",    execute_nmos_documented, run_nmos_documented,
+      OPS_OFFICIAL },
+    { "nmos-documented-nodecimal",   "Documented opcodes, no decimal mode",   execute_nmos_documented_nodecimal, run_nmos_documented_nodecimal,
+      OPS_OFFICIAL },
+#endif
+#if CPU_VARIANTS & CPU_VARIANT_65C02
+    { "65c02",                       "65C02 opcodes and decimal mode",        execute_65c02, run_65c02,
+      OPS_OFFICIAL | OPS_65C02 },
+    { "65c02-nodecimal",             "65C02 opcode set, no decimal mode",     execute_65c02_nodecimal, run_65c02_nodecimal,
+      OPS_OFFICIAL | OPS_65C02 },
+#endif
+#if CPU_VARIANTS & CPU_VARIANT_LEGACY
+    { "legacy",                      "Original mixed table (execute())",      execute, run_legacy,
+      OPS_OFFICIAL | OPS_ILLEGAL | OPS_65C02 | OPS_LEGACY },
+#endif
+    { NULL, NULL, NULL, NULL, 0 },
+};
+
+const CpuVariant *find_cpu_variant(const char *name) {
+    for (const CpuVariant *variant = cpu_variants; variant->name; variant++) {
+        if (strcmp(variant->name, name) == 0)
+            return variant;
+    }
+    return NULL;
+}
+
+void list_cpu_variants(void) {
+    for (const CpuVariant *variant = cpu_variants; variant->name; variant++)
+        printf("  %-28s %s\n", variant->name, variant->description);
+}
@@ -0,0 +1,32 @@
+#ifndef VARIANTS_H
+#define VARIANTS_H
+
+#include "cpu.h"
+
+// Variants compiled in; clear bits with -DCPU_VARIANTS=... to drop them
+#define CPU_VARIANT_NMOS            0x01
+#define CPU_VARIANT_NMOS_DOCUMENTED 0x02
+#define CPU_VARIANT_65C02           0x04
+#define CPU_VARIANT_LEGACY          0x08
+
+#ifndef CPU_VARIANTS
+#define CPU_VARIANTS (CPU_VARIANT_NMOS | CPU_VARIANT_NMOS_DOCUMENTED | \
+                      CPU_VARIANT_65C02 | CPU_VARIANT_LEGACY)
+#endif
+
+typedef void (*ExecuteFunction)(CPU *cpu, uint8_t *memory);
+
+typedef struct {
+    const char *name;
+    const char *description;
+    ExecuteFunction execute;   // One instruction
+    ExecuteFunction run;       // Until the CPU halts
+    uint8_t opcodes;           // OPS_* sets execute decodes
+} CpuVariant;
+
+extern const CpuVariant cpu_variants[];
+
+const CpuVariant *find_cpu_variant(const char *name);
+void list_cpu_variants(void);
+
+#endif
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/disasm.h"
+#include <string.h>
+#include <time.h>
+
+// Disassembler front end: loads a raw image, separates code from data by
+// tracing from the load address, the hardware vectors and any --entry
+// points, and lists the result with generated labels. Throughput of the
+// listing pass goes to stderr.
+
+#define MAX_ENTRIES  32
+
+static Disassembly disassembly;
+static DisasmOutput output;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_usage(void) {
+    printf("Usage: 6502-disasm [options] <bin_file>\n");
+    printf("  -o <file>              Output listing (default: stdout)\n");
+    printf("  --load <addr>          Load address (default: 0600)\n");
+    printf("  --entry <addr>         Additional entry point, repeatable\n");
+    printf("  --no-vectors           Do not trace from $FFFA-$FFFF\n");
+    printf("  --linear               Decode every byte not reached by tracing\n");
+    printf("  --range <lo>-<hi>      List only an address range\n");
+}
+
+int main(int argc, char **argv) {
+    const char *input = NULL;
+    const char *output_path = NULL;
+    unsigned int load_address = 0x0600;
+    unsigned int entries[MAX_ENTRIES];
+    int entry_count = 0;
+    int vectors = 1;
+    int linear = 0;
+    unsigned int first = 0, last = 0;
+    int has_range = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%x", &load_address);
+        } else if (strcmp(argv[i], "--entry") == 0 && i + 1 < argc && entry_count < MAX_ENTRIES) {
+            sscanf(argv[++i], "%x", &entries[entry_count++]);
+        } else if (strcmp(argv[i], "--no-vectors") == 0) {
+            vectors = 0;
+        } else if (strcmp(argv[i], "--linear") == 0) {
+            linear = 1;
+        } else if (strcmp(argv[i], "--range") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%x-%x", &first, &last) == 2) {
+            i++;
+            has_range = 1;
+        } else if (argv[i][0] == '-') {
+            print_usage();
+            return 1;
+        } else {
+            input = argv[i];
+        }
+    }
+
+    if (input == NULL || load_address >= MEMORY_SIZE ||
+        (has_range && (first > last || last >= MEMORY_SIZE))) {
+        print_usage();
+        return 1;
+    }
+
+    FILE *file = fopen(input, "rb");
+    if (file == NULL) {
+        printf("Error: Unable to open ROM file %s\n", input);
+        return 1;
+    }
+    static uint8_t data[MEMORY_SIZE];
+    size_t size = fread(data, sizeof(uint8_t), MEMORY_SIZE - load_address, file);
+    fclose(file);
+    if (size == 0) {
+        printf("Error: ROM file %s is empty\n", input);
+        return 1;
+    }
+
+    disasm_init(&disassembly);
+    disasm_load(&disassembly, data, size, load_address);
+    disasm_trace(&disassembly, load_address);
+    for (int i = 0; i < entry_count; i++)
+        disasm_trace(&disassembly, entries[i]);
+    if (vectors)
+        disasm_trace_vectors(&disassembly);
+    if (!has_range) {
+        first = load_address;
+        last = load_address + size - 1;
+    }
+    if (linear)
+        disasm_mark_linear(&disassembly, first, last);
+
+    output.file = stdout;
+    if (output_path && (output.file = fopen(output_path, "w")) == NULL) {
+        printf("Error: Unable to open output file %s\n", output_path);
+        return 1;
+    }
+
+    double start = now_seconds();
+    disasm_list(&disassembly, first, last, &output);
+    disasm_flush(&output);
+    double elapsed = now_seconds() - start;
+    if (output.file != stdout)
+        fclose(output.file);
+
+    int instructions = 0, labels = 0;
+    for (unsigned int address = first; address <= last; address++) {
+        instructions += (disassembly.flags[address] & DISASM_CODE) != 0;
+        labels += (disassembly.flags[address] &
+                   (DISASM_LABEL | DISASM_SUBROUTINE | DISASM_DATA_LABEL)) != 0;
+    }
+    fprintf(stderr, "%d instructions, %d labels, %u bytes in %.3f ms (%.1f MB/s)\n",
+            instructions, labels, last - first + 1, elapsed * 1e3,
+            elapsed > 0 ? (last - first + 1) / elapsed / 1e6 : 0.0);
+    return 0;
+}
@@ -0,0 +1,328 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/cpu.h"
+#include "../src/memory.h"
+#include "../src/opcodes.h"
+#include "../src/variants.h"
+#include "../src/fusion.h"
+#include "perfcount.h"
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Per-opcode microbenchmark: every opcode the chosen engine decodes runs in
+// a generated loop, timed with the monotonic clock and measured with the
+// hardware counters. The table is one line per opcode in opcode order so
+// two builds can be compared with diff, or with --baseline, which adds the
+// change in ns/op against an earlier table.
+//
+// Straight-line opcodes are unrolled UNROLL times and closed with a JMP,
+// so the loop overhead is one instruction in UNROLL + 1. Control flow
+// opcodes loop on themselves: JMP and JSR target their own address, BRK
+// vectors to itself, and RTS and RTI pop from a stack page filled with a
+// byte that forms their own address, so the stack pointer may wrap freely.
+
+#define LOOP_START     0x0400
+#define UNROLL         256
+#define DATA_ZERO_PAGE 0x80     // Zero page operand
+#define DATA_POINTER   0xF0     // Zero page pointer to DATA_ABSOLUTE
+#define DATA_ABSOLUTE  0x0300   // Absolute operand; indexed accesses stay below $0400
+
+static const char *const mode_names[] = {
+    "implied", "accumulator", "immediate", "zp", "zp,x", "zp,y", "abs", "abs,x",
+    "abs,y", "(abs)", "(zp,x)", "(zp),y", "(zp)", "relative",
+};
+
+typedef struct {
+    const char *name;
+    ExecuteFunction execute;    // NULL for fused dispatch
+    uint8_t opcodes;            // OPS_* sets decoded
+} Engine;
+
+typedef struct {
+    double ns;
+    double counters[PERF_COUNTER_COUNT];    // Per instruction, -1 when unavailable
+} Result;
+
+static PerfCounters perf;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_usage(void) {
+    printf("Usage: 6502-opbench [options]\n");
+    printf("  --engine <name>        reference, fused or a CPU variant (default: reference)\n");
+    printf("  --steps <n>            Instructions per measurement (default: 1000000)\n");
+    printf("  --repeat <n>           Measurements per opcode, the fastest is kept (default: 3)\n");
+    printf("  --opcode <hex>         Benchmark only this opcode, repeatable\n");
+    printf("  --baseline <file>      Add the ns/op change against an earlier table\n");
+    printf("  -o <file>              Output table (default: stdout)\n");
+}
+
+static int resolve_engine(const char *name, Engine *engine) {
+    engine->name = name;
+    engine->execute = execute;
+    engine->opcodes = OPS_OFFICIAL | OPS_ILLEGAL | OPS_65C02 | OPS_LEGACY;
+    if (strcmp(name, "fused") == 0) {
+        engine->execute = NULL;
+        fusion_enable_defaults();
+    } else if (strcmp(name, "reference") != 0) {
+        const CpuVariant *variant = find_cpu_variant(name);
+        if (variant == NULL) {
+            printf("Error: Unknown engine %s\n", name);
+            list_cpu_variants();
+            return -1;
+        }
+        engine->execute = variant->execute;
+        engine->opcodes = variant->opcodes;
+    }
+    return 0;
+}
+
+static void put_instruction(uint16_t *address, uint8_t opcode, uint16_t operand) {
+    const OpcodeInfo *info = &opcode_table[opcode];
+    write_memory((*address)++, opcode);
+    if (info->length > 1)
+        write_memory((*address)++, operand & 0xFF);
+    if (info->length > 2)
+        write_memory((*address)++, operand >> 8);
+}
+
+static uint16_t default_operand(uint8_t mode) {
+    switch (mode) {
+        case MODE_IMMEDIATE:
+            return 0x01;
+        case MODE_ZERO_PAGE:
+        case MODE_ZERO_PAGE_X:
+        case MODE_ZERO_PAGE_Y:
+            return DATA_ZERO_PAGE;
+        case MODE_INDEXED_INDIRECT:
+        case MODE_INDIRECT_INDEXED:
+        case MODE_ZERO_PAGE_INDIRECT:
+            return DATA_POINTER;
+        case MODE_RELATIVE:
+            return 0x00;    // Taken or not, the branch lands on the next copy
+        default:
+            return DATA_ABSOLUTE;
+    }
+}
+
+// Writes the loop for <opcode> into a cleared machine and resets <cpu> to it
+static void build_loop(CPU *cpu, uint8_t opcode) {
+    const OpcodeInfo *info = &opcode_table[opcode];
+    const char *mnemonic = info->mnemonic;
+    uint16_t address = LOOP_START;
+
+    memset(memory, 0, MEMORY_SIZE);
+    memset(rom, 0, ROM_SIZE);
+    initialize_memory();
+    reset_cpu(cpu);
+    write_memory(DATA_POINTER, DATA_ABSOLUTE & 0xFF);
+    write_memory(DATA_POINTER + 1, DATA_ABSOLUTE >> 8);
+
+    if (strcmp(mnemonic, "JMP") == 0 || strcmp(mnemonic, "JSR") == 0) {
+        // JMP ($0300) reads its own address from the data area
+        write_memory(DATA_ABSOLUTE, LOOP_START & 0xFF);
+        write_memory(DATA_ABSOLUTE + 1, LOOP_START >> 8);
+        put_instruction(&address, opcode, info->mode == MODE_INDIRECT ? DATA_ABSOLUTE : LOOP_START);
+    } else if (strcmp(mnemonic, "BRK") == 0) {
+        rom[0xFFFE - ROM_START] = LOOP_START & 0xFF;
+        rom[0xFFFF - ROM_START] = LOOP_START >> 8;
+        put_instruction(&address, opcode, 0);
+    } else if (strcmp(mnemonic, "RTS") == 0 || strcmp(mnemonic, "RTI") == 0) {
+        // Every stack byte is the high byte of LOOP_START, so each pull
+        // returns to $0404 (RTI) or $0404 + 1 (RTS) whatever the pointer
+        for (int i = 0; i < 0x100; i++)
+            write_memory(STACK_START + i, LOOP_START >> 8);
+        address = (LOOP_START & 0xFF00) | (LOOP_START >> 8);
+        if (strcmp(mnemonic, "RTS") == 0)
+            address++;
+        cpu->PC = address;
+        put_instruction(&address, opcode, 0);
+        return;
+    } else {
+        for (int i = 0; i < UNROLL; i++)
+            put_instruction(&address, opcode, default_operand(info->mode));
+        put_instruction(&address, 0x4C, LOOP_START);
+    }
+    cpu->PC = LOOP_START;
+}
+
+static uint64_t run_loop(const Engine *engine, CPU *cpu, uint64_t steps) {
+    uint64_t retired = 0;
+    if (engine->execute) {
+        for (; retired < steps; retired++)
+            engine->execute(cpu, memory);
+    } else {
+        while (retired < steps)
+            retired += execute_fused(cpu, memory);
+    }
+    return retired;
+}
+
+static void measure(const Engine *engine, uint8_t opcode, uint64_t steps, int repeat,
+                    Result *best) {
+    static CPU cpu;
+
+    best->ns = -1;
+    for (int r = 0; r < repeat; r++) {
+        build_loop(&cpu, opcode);
+        run_loop(engine, &cpu, steps / 16);
+
+        perf_counters_start(&perf);
+        double start = now_seconds();
+        uint64_t retired = run_loop(engine, &cpu, steps);
+        double elapsed = now_seconds() - start;
+        perf_counters_stop(&perf);
+
+        double ns = elapsed * 1e9 / retired;
+        if (best->ns >= 0 && ns >= best->ns)
+            continue;
+        best->ns = ns;
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+            best->counters[i] = perf.values[i] >= 0 ? perf.values[i] / retired : -1;
+    }
+}
+
+// Reads the ns/op column of a table written by this tool
+static int load_baseline(const char *filename, double *baseline) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error: Unable to open baseline %s\n", filename);
+        return -1;
+    }
+    for (int i = 0; i < 256; i++)
+        baseline[i] = -1;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned int opcode;
+        double ns;
+        if (line[0] != '#' && sscanf(line, "%x %*s %*s %lf", &opcode, &ns) == 2 && opcode < 256)
+            baseline[opcode] = ns;
+    }
+    fclose(file);
+    return 0;
+}
+
+static void print_header(FILE *out, const Engine *engine, uint64_t steps, int repeat,
+                         int baseline) {
+    fprintf(out, "# 6502-opbench engine=%s steps=%llu repeat=%d unroll=%d\n",
+            engine->name, (unsigned long long)steps, repeat, UNROLL);
+    fprintf(out, "# counters are per emulated instruction; - when unavailable\n");
+    fprintf(out, "%-3s %-4s %-11s %8s", "op", "mne", "mode", "ns/op");
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+        fprintf(out, " %9s", perf_counter_names[i]);
+    if (baseline)
+        fprintf(out, " %8s", "delta");
+    fprintf(out, "\n");
+}
+
+static void print_result(FILE *out, uint8_t opcode, const Result *result, double baseline) {
+    const OpcodeInfo *info = &opcode_table[opcode];
+
+    fprintf(out, "%02X  %-4s %-11s %8.2f", opcode, info->mnemonic, mode_names[info->mode],
+            result->ns);
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (result->counters[i] >= 0)
+            fprintf(out, " %9.3f", result->counters[i]);
+        else
+            fprintf(out, " %9s", "-");
+    }
+    if (baseline > 0)
+        fprintf(out, " %+7.1f%%", (result->ns / baseline - 1) * 100);
+    else if (baseline == 0)
+        fprintf(out, " %8s", "new");
+    fprintf(out, "\n");
+}
+
+int main(int argc, char **argv) {
+    const char *engine_name = "reference";
+    const char *output_path = NULL;
+    const char *baseline_path = NULL;
+    uint64_t steps = 1000000;
+    int repeat = 3;
+    static uint8_t selected[256];
+    int selected_count = 0;
+    static double baseline[256];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            engine_name = argv[++i];
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--opcode") == 0 && i + 1 < argc) {
+            selected[strtoul(argv[++i], NULL, 16) & 0xFF] = 1;
+            selected_count++;
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (steps < 16 || repeat < 1) {
+        print_usage();
+        return 1;
+    }
+
+    Engine engine;
+    if (resolve_engine(engine_name, &engine) < 0)
+        return 1;
+    if (baseline_path && load_baseline(baseline_path, baseline) < 0)
+        return 1;
+
+    FILE *out = stdout;
+    if (output_path && (out = fopen(output_path, "w")) == NULL) {
+        printf("Error: Unable to open output file %s\n", output_path);
+        return 1;
+    }
+
+    int opened = perf_counters_open(&perf);
+    if (opened == 0)
+        fprintf(stderr, "Hardware counters unavailable (%s), timing only\n", strerror(errno));
+    else if (opened < PERF_COUNTER_COUNT)
+        fprintf(stderr, "%d of %d hardware counters available\n", opened, PERF_COUNTER_COUNT);
+
+    print_header(out, &engine, steps, repeat, baseline_path != NULL);
+    int measured = 0, slower = 0, compared = 0;
+    double log_ratio = 0;
+    for (int opcode = 0; opcode < 256; opcode++) {
+        const OpcodeInfo *info = &opcode_table[opcode];
+        if (info->mnemonic == NULL || !(info->variants & engine.opcodes) ||
+            (selected_count > 0 && !selected[opcode]))
+            continue;
+
+        Result result;
+        measure(&engine, opcode, steps, repeat, &result);
+        double reference = -1;
+        if (baseline_path) {
+            reference = baseline[opcode] > 0 ? baseline[opcode] : 0;
+            if (reference > 0) {
+                log_ratio += log(result.ns / reference);
+                slower += result.ns > reference * 1.1;
+                compared++;
+            }
+        }
+        print_result(out, opcode, &result, reference);
+        fflush(out);
+        measured++;
+    }
+    perf_counters_close(&perf);
+    if (out != stdout)
+        fclose(out);
+
+    fprintf(stderr, "%d opcodes measured on %s\n", measured, engine.name);
+    if (compared > 0)
+        fprintf(stderr, "Against %s: geometric mean %+.1f%%, %d of %d opcodes more than 10%% slower\n",
+                baseline_path, (exp(log_ratio / compared) - 1) * 100, slower, compared);
+    return 0;
+}
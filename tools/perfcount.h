@@ -0,0 +1,34 @@
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdint.h>
+
+// Hardware performance counters of the calling thread through
+// perf_event_open(2), user space only. Each event is opened on its own so
+// a PMU that lacks one (L1I misses on many cores, everything inside most
+// containers) still reports the rest; counts are scaled when the kernel
+// multiplexed an event.
+
+typedef enum {
+    PERF_COUNTER_CYCLES,
+    PERF_COUNTER_INSTRUCTIONS,
+    PERF_COUNTER_BRANCH_MISSES,
+    PERF_COUNTER_L1D_MISSES,
+    PERF_COUNTER_L1I_MISSES,
+    PERF_COUNTER_COUNT
+} PerfCounterId;
+
+typedef struct {
+    int fds[PERF_COUNTER_COUNT];            // -1 when the event did not open
+    double values[PERF_COUNTER_COUNT];      // Filled by perf_counters_stop()
+} PerfCounters;
+
+extern const char *const perf_counter_names[PERF_COUNTER_COUNT];
+
+// Returns the number of events opened; errno holds the first failure
+int perf_counters_open(PerfCounters *counters);
+void perf_counters_close(PerfCounters *counters);
+void perf_counters_start(PerfCounters *counters);
+void perf_counters_stop(PerfCounters *counters);
+
+#endif
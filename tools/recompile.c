@@ -0,0 +1,370 @@
+#include "../src/opcodes.h"
+#include <string.h>
+
+// Ahead-of-time recompiler: walks a 6502 image from its entry points using
+// the opcode table shared with execute() and writes a C translation unit
+// with one function per basic block. Blocks call the regular handlers, so
+// operands are still read through the bus at run time; only opcode bytes
+// are fixed at translation time. Anything the walker cannot prove static
+// (indirect jumps, code that is stored to, unknown opcodes) is left to the
+// interpreter through the generated dispatcher. Stores the walker cannot
+// see ((zp),Y, DMA, HLE copies) are caught at run time: a block checks
+// the bytes it was compiled from before running and otherwise declines,
+// so the interpreter executes the new code.
+
+#define MAX_ENTRIES  32
+#define MAX_RANGES   32
+
+static uint8_t image[MEMORY_SIZE];
+static uint8_t loaded[MEMORY_SIZE];
+static uint8_t is_code[MEMORY_SIZE];
+static uint8_t is_leader[MEMORY_SIZE];
+static uint8_t interpret[MEMORY_SIZE];
+
+static uint16_t worklist[MEMORY_SIZE];
+static int worklist_size = 0;
+
+static void push_leader(uint16_t address) {
+    if (!is_leader[address]) {
+        is_leader[address] = 1;
+        worklist[worklist_size++] = address;
+    }
+}
+
+static int is_flow_end(uint8_t opcode) {
+    const OpcodeInfo *info = &opcode_table[opcode];
+    return info->mode == MODE_RELATIVE || opcode == 0x4C || opcode == 0x20 ||
+           opcode == 0x6C || opcode == 0x60 || opcode == 0x40 ||
+           opcode == 0x00 || opcode == 0x02;
+}
+
+// Branch and JMP operands are baked into the generated code
+static int bakes_operand(uint8_t opcode) {
+    return opcode_table[opcode].mode == MODE_RELATIVE || opcode == 0x4C;
+}
+
+static int decodable(uint16_t address) {
+    if (!loaded[address] || interpret[address])
+        return 0;
+    const OpcodeInfo *info = &opcode_table[image[address]];
+    if (info->mnemonic == NULL)
+        return 0;
+    for (int i = 1; i < info->length; i++) {
+        if (!loaded[(uint16_t)(address + i)])
+            return 0;
+    }
+    return 1;
+}
+
+static void walk(void) {
+    while (worklist_size > 0) {
+        uint16_t address = worklist[--worklist_size];
+
+        while (!is_code[address] && decodable(address)) {
+            uint8_t opcode = image[address];
+            const OpcodeInfo *info = &opcode_table[opcode];
+            uint16_t operand = image[(uint16_t)(address + 1)] |
+                               (image[(uint16_t)(address + 2)] << 8);
+            uint16_t next = address + info->length;
+
+            is_code[address] = 1;
+
+            if (info->mode == MODE_RELATIVE) {
+                push_leader(next + (int8_t)(operand & 0xFF));
+                push_leader(next);
+            } else if (opcode == 0x4C) {
+                push_leader(operand);
+            } else if (opcode == 0x20) {
+                push_leader(operand);
+                push_leader(next);
+            }
+            if (is_flow_end(opcode))
+                break;
+            address = next;
+        }
+    }
+}
+
+static int writes_memory(const OpcodeInfo *info) {
+    static const char *stores[] = {
+        "STA", "STX", "STY", "INC", "DEC", "ASL", "LSR", "ROL", "ROR",
+        "SAX", "DCP", "ISB", "SLO", "SRE", NULL
+    };
+    if (info->mode == MODE_ACCUMULATOR || info->mode == MODE_IMPLIED)
+        return 0;
+    for (int i = 0; stores[i]; i++) {
+        if (strcmp(info->mnemonic, stores[i]) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Marks compiled instructions that the program can statically be seen to
+// store into. Returns the number of newly interpreted instructions.
+static int mark_self_modifying(void) {
+    static uint8_t written[MEMORY_SIZE];
+    memset(written, 0, sizeof(written));
+
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        if (!is_code[address])
+            continue;
+        const OpcodeInfo *info = &opcode_table[image[address]];
+        if (!writes_memory(info))
+            continue;
+
+        uint16_t target = image[(uint16_t)(address + 1)];
+        int span = 1;
+        if (info->length == 3)
+            target |= image[(uint16_t)(address + 2)] << 8;
+        if (info->mode == MODE_ABSOLUTE_X || info->mode == MODE_ABSOLUTE_Y)
+            span = 256;
+
+        for (int i = 0; i < span; i++) {
+            uint16_t byte = target + i;
+            if (byte < ROM_START)
+                written[byte] = 1;
+        }
+    }
+
+    int marked = 0;
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        if (!is_code[address])
+            continue;
+        uint8_t opcode = image[address];
+        int checked = bakes_operand(opcode) ? opcode_table[opcode].length : 1;
+        for (int i = 0; i < checked; i++) {
+            if (written[(uint16_t)(address + i)]) {
+                interpret[address] = 1;
+                marked++;
+                break;
+            }
+        }
+    }
+    return marked;
+}
+
+static void emit_instruction(FILE *out, uint16_t address) {
+    uint8_t opcode = image[address];
+    const OpcodeInfo *info = &opcode_table[opcode];
+    uint16_t next = address + info->length;
+    uint16_t operand = image[(uint16_t)(address + 1)] |
+                       (image[(uint16_t)(address + 2)] << 8);
+
+    if (info->mode == MODE_RELATIVE) {
+        static const char *conditions[8] = {
+            "!CHECK_FLAG(cpu, FLAG_NEGATIVE)", "CHECK_FLAG(cpu, FLAG_NEGATIVE)",
+            "!CHECK_FLAG(cpu, FLAG_OVERFLOW)", "CHECK_FLAG(cpu, FLAG_OVERFLOW)",
+            "!CHECK_FLAG(cpu, FLAG_CARRY)",    "CHECK_FLAG(cpu, FLAG_CARRY)",
+            "!CHECK_FLAG(cpu, FLAG_ZERO)",     "CHECK_FLAG(cpu, FLAG_ZERO)",
+        };
+        uint16_t target = next + (int8_t)(operand & 0xFF);
+        fprintf(out, "    cpu->PC = (%s) ? 0x%04X : 0x%04X; // %s\n",
+                conditions[opcode >> 5], target, next, info->mnemonic);
+    } else if (opcode == 0x4C) {
+        fprintf(out, "    cpu->PC = 0x%04X; // JMP\n", operand);
+    } else {
+        fprintf(out, "    cpu->PC = 0x%04X; %s;\n", (uint16_t)(address + 1), info->handler);
+    }
+}
+
+// The instruction after <address> when it continues the same block
+static int block_continues(uint16_t address) {
+    uint8_t opcode = image[address];
+    uint16_t next = address + opcode_table[opcode].length;
+    return !is_flow_end(opcode) && !is_leader[next] && is_code[next] && !interpret[next];
+}
+
+// Declines the block when memory no longer holds its opcodes and baked
+// operands; other operand bytes are read at run time anyway
+static void emit_guard(FILE *out, uint16_t leader) {
+    const char *separator = "    if (";
+    for (uint16_t address = leader;; address += opcode_table[image[address]].length) {
+        uint8_t opcode = image[address];
+        int checked = bakes_operand(opcode) ? opcode_table[opcode].length : 1;
+        for (int i = 0; i < checked; i++) {
+            uint16_t byte = address + i;
+            fprintf(out, "%sCODE_CHANGED(0x%04X, 0x%02X)", separator, byte, image[byte]);
+            separator = " ||\n        ";
+        }
+        if (!block_continues(address))
+            break;
+    }
+    fprintf(out, ")\n        return 0;\n");
+}
+
+static void emit_block(FILE *out, uint16_t leader) {
+    uint16_t address = leader;
+    unsigned int cycles = 0;
+
+    fprintf(out, "static int block_%04X(CPU *cpu) {\n", leader);
+    emit_guard(out, leader);
+    for (;;) {
+        uint8_t opcode = image[address];
+        emit_instruction(out, address);
+        cycles += opcode_table[opcode].cycles;
+        if (!block_continues(address)) {
+            if (!is_flow_end(opcode))
+                fprintf(out, "    cpu->PC = 0x%04X;\n", (uint16_t)(address + opcode_table[opcode].length));
+            break;
+        }
+        address += opcode_table[opcode].length;
+    }
+    fprintf(out, "    cpu->cycles += %u;\n", cycles);
+    fprintf(out, "    return 1;\n");
+    fprintf(out, "}\n\n");
+}
+
+static void emit_main(FILE *out, uint16_t load_address, int size) {
+    fprintf(out, "static const uint8_t image[%d] = {", size);
+    for (int i = 0; i < size; i++)
+        fprintf(out, "%s0x%02X,", i % 12 ? " " : "\n    ", image[(uint16_t)(load_address + i)]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "int main(void) {\n");
+    fprintf(out, "    CPU cpu;\n");
+    fprintf(out, "    initialize_memory();\n");
+    fprintf(out, "    reset_cpu(&cpu);\n");
+    fprintf(out, "    cpu.PC = 0x%04X;\n\n", load_address);
+    // Into ram[] whole, as load_program() does, so both engines start
+    // from the same memory even when the image reaches ROM_START
+    fprintf(out, "    for (int i = 0; i < %d; i++)\n", size);
+    fprintf(out, "        current_bus->ram[0x%04X + i] = image[i];\n\n", load_address);
+    fprintf(out, "    recompiled_run(&cpu);\n\n");
+    fprintf(out, "    printf(\"Final CPU State:\\n\");\n");
+    fprintf(out, "    printf(\"Accumulator: %%02X\\n\", cpu.A);\n");
+    fprintf(out, "    printf(\"X Register: %%02X\\n\", cpu.X);\n");
+    fprintf(out, "    printf(\"Y Register: %%02X\\n\", cpu.Y);\n");
+    fprintf(out, "    printf(\"Status: %%02X\\n\", cpu.status);\n");
+    fprintf(out, "    printf(\"Program Counter: %%04X\\n\", cpu.PC);\n");
+    fprintf(out, "    printf(\"Stack Pointer: %%02X\\n\", cpu.SP);\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+}
+
+static void emit(FILE *out, const char *source, uint16_t load_address, int size, int with_main) {
+    fprintf(out, "// Generated by 6502-recompile from %s; do not edit.\n", source);
+    fprintf(out, "#include \"cpu.h\"\n");
+    fprintf(out, "#include \"memory.h\"\n\n");
+    fprintf(out, "// Through the page table, so neither bus statistics nor devices see it\n");
+    fprintf(out, "#define CODE_CHANGED(address, value) \\\n");
+    fprintf(out, "    (current_bus->read_pages[(address) >> 8] == NULL || \\\n");
+    fprintf(out, "     current_bus->read_pages[(address) >> 8][(address) & 0xFF] != (value))\n\n");
+
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        if (is_leader[address] && is_code[address] && !interpret[address])
+            emit_block(out, address);
+    }
+
+    fprintf(out, "// Runs one compiled block; returns 0 when PC has no block or its code\n");
+    fprintf(out, "// has changed since translation\n");
+    fprintf(out, "int recompiled_step(CPU *cpu) {\n");
+    fprintf(out, "    switch (cpu->PC) {\n");
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        if (is_leader[address] && is_code[address] && !interpret[address])
+            fprintf(out, "        case 0x%04X: return block_%04X(cpu);\n", address, address);
+    }
+    fprintf(out, "        default: return 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n\n");
+
+    fprintf(out, "void recompiled_run(CPU *cpu) {\n");
+    fprintf(out, "    while (cpu->is_running) {\n");
+    fprintf(out, "        if (!recompiled_step(cpu))\n");
+    fprintf(out, "            execute(cpu, memory);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n\n");
+
+    if (with_main)
+        emit_main(out, load_address, size);
+}
+
+static void print_usage(void) {
+    printf("Usage: 6502-recompile [options] <bin_file>\n");
+    printf("  -o <file>              Output C file (default: stdout)\n");
+    printf("  --load <addr>          Load address (default: 0600)\n");
+    printf("  --entry <addr>         Additional entry point, repeatable\n");
+    printf("  --interpret <lo>-<hi>  Leave an address range to the interpreter\n");
+    printf("  --main                 Embed the image and emit a main()\n");
+}
+
+int main(int argc, char **argv) {
+    const char *input = NULL;
+    const char *output = NULL;
+    unsigned int load_address = 0x0600;
+    unsigned int entries[MAX_ENTRIES];
+    int entry_count = 0;
+    int with_main = 0;
+
+    for (int i = 1; i < argc; i++) {
+        unsigned int lo, hi;
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%x", &load_address);
+        } else if (strcmp(argv[i], "--entry") == 0 && i + 1 < argc && entry_count < MAX_ENTRIES) {
+            sscanf(argv[++i], "%x", &entries[entry_count++]);
+        } else if (strcmp(argv[i], "--interpret") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%x-%x", &lo, &hi) == 2) {
+            i++;
+            for (unsigned int address = lo; address <= hi && address < MEMORY_SIZE; address++)
+                interpret[address] = 1;
+        } else if (strcmp(argv[i], "--main") == 0) {
+            with_main = 1;
+        } else if (argv[i][0] == '-') {
+            print_usage();
+            return 1;
+        } else {
+            input = argv[i];
+        }
+    }
+
+    if (input == NULL || load_address >= MEMORY_SIZE) {
+        print_usage();
+        return 1;
+    }
+
+    FILE *file = fopen(input, "rb");
+    if (file == NULL) {
+        printf("Error: Unable to open ROM file %s\n", input);
+        return 1;
+    }
+    int size = fread(&image[load_address], sizeof(uint8_t), MEMORY_SIZE - load_address, file);
+    fclose(file);
+    for (int i = 0; i < size; i++)
+        loaded[load_address + i] = 1;
+
+    push_leader(load_address);
+    for (int i = 0; i < entry_count; i++)
+        push_leader(entries[i]);
+    // Hardware vectors, when the image covers them
+    for (int vector = 0xFFFA; vector <= 0xFFFE; vector += 2) {
+        if (loaded[vector] && loaded[vector + 1])
+            push_leader(image[vector] | (image[vector + 1] << 8));
+    }
+    walk();
+
+    // Interpreted instructions hand control back at the next address
+    int marked = mark_self_modifying();
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        if (is_code[address] && interpret[address])
+            is_leader[(uint16_t)(address + opcode_table[image[address]].length)] = 1;
+    }
+
+    FILE *out = stdout;
+    if (output && (out = fopen(output, "w")) == NULL) {
+        printf("Error: Unable to open output file %s\n", output);
+        return 1;
+    }
+    emit(out, input, load_address, size, with_main);
+    if (out != stdout)
+        fclose(out);
+
+    int blocks = 0, instructions = 0;
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        blocks += is_leader[address] && is_code[address] && !interpret[address];
+        instructions += is_code[address];
+    }
+    fprintf(stderr, "%d instructions in %d blocks, %d left to the interpreter\n",
+            instructions, blocks, marked);
+    return 0;
+}